@@ -0,0 +1,738 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+#include "json.h"
+#include "evaluator.h"
+#include "json_stream.h"
+#include "json_writer.h"
+#include "mapped_file.h"
+#include "number_format.h"
+#include "number_parser.h"
+#include "reduce.h"
+#include "string_parser.h"
+#include "structural_parser.h"
+#include "thread_pool.h"
+
+// Counts every global heap allocation so benchmarks can report them.
+// The deletes are kept out of line; once inlined, GCC pairs free() with operator new and warns.
+static std::atomic<size_t> allocations{0};
+static std::atomic<size_t> allocated_bytes{0};
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(size_t size, std::align_val_t align) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    size_t alignment = static_cast<size_t>(align);
+    if (void* p = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)) return p;
+    throw std::bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void* p) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { operator delete(p); }
+__attribute__((noinline)) void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t, std::align_val_t align) noexcept { operator delete(p, align); }
+
+// Runs fn `iterations` times and returns the average cost of one call in nanoseconds
+template <typename F>
+double time_ns(size_t iterations, F fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) fn();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+// Builds {"a": {"b": [0, 1, 2]}, "pad": [...]} where "pad" holds `records` small objects
+std::string make_document(size_t records) {
+    std::string text = R"({"a": {"b": [0, 1, 2]}, "pad": [)";
+    for (size_t i = 0; i < records; ++i) {
+        if (i) text += ", ";
+        text += R"({"id": )" + std::to_string(i) + R"(, "name": "record", "tags": [1, 2, 3]})";
+    }
+    text += "]}";
+    return text;
+}
+
+void bench_path_lookup() {
+    std::cout << "== Path lookup vs document size ==" << std::endl;
+    for (size_t records : {10, 1000, 100000}) {
+        JSONValue json = JSON::parse(make_document(records));
+        Evaluator evaluator(json);
+        double ns = time_ns(10000, [&] { evaluator.evaluate("a.b[0] + a.b[1]"); });
+        std::cout << "records=" << records << "\t" << ns << " ns/eval" << std::endl;
+    }
+}
+
+void bench_shared_document() {
+    std::cout << "== Evaluator construction: copied tree vs shared document ==" << std::endl;
+    JSONDocumentPtr document = JSONDocument::parse(make_document(100000));
+    double copied = time_ns(10, [&] { Evaluator evaluator(document->root()); });
+    double shared = time_ns(10000, [&] { Evaluator evaluator(document); });
+    std::cout << "copied\t" << copied << " ns/evaluator" << std::endl;
+    std::cout << "shared\t" << shared << " ns/evaluator" << std::endl;
+}
+
+void bench_compiled_expression() {
+    std::cout << "== Expression: re-parsed string vs compiled once ==" << std::endl;
+    JSONDocumentPtr document = JSONDocument::parse(make_document(10));
+    Evaluator evaluator(document);
+    std::string expr = "a.b[0]";
+    for (int i = 0; i < 32; ++i) expr += (i % 2 ? " * a.b[1]" : " + a.b[2]");
+    CompiledExpression compiled = CompiledExpression::compile(expr);
+    double parsed = time_ns(10000, [&] { evaluator.evaluate(expr); });
+    double reused = time_ns(10000, [&] { evaluator.evaluate(compiled); });
+    std::cout << "string\t" << parsed << " ns/eval" << std::endl;
+    std::cout << "compiled\t" << reused << " ns/eval" << std::endl;
+}
+
+void bench_tree_vs_vm() {
+    std::cout << "== Tree-walking interpreter vs bytecode VM ==" << std::endl;
+    JSONDocumentPtr document = JSONDocument::parse(R"({"a": {"b": [1, 2, 3, 4]}, "x": 2.5, "y": 4})");
+    Evaluator evaluator(document);
+    const char* expressions[] = {
+        "a.b[0] + a.b[1] * a.b[2] - a.b[3] / 2",
+        "abs(x - y) * round(x) + (x ** 2) % 7",
+        "(x || y) && !(a.b[0] && 0)",
+        "1 + 2 * 3 - 4 / 5 + 6 * 7 - 8 + 9 * 10 - 11 / 12",
+        "max(a.b[0], a.b[1], x, y) + min(x, y) * size(a.b)",
+    };
+    for (const char* expr : expressions) {
+        CompiledExpression compiled = CompiledExpression::compile(expr);
+        double tree = time_ns(100000, [&] { evaluator.evaluate_tree(compiled); });
+        double vm = time_ns(100000, [&] { evaluator.evaluate(compiled); });
+        std::cout << expr << "\n\ttree " << tree << " ns/eval\tvm " << vm << " ns/eval" << std::endl;
+    }
+}
+
+void bench_jit() {
+    std::cout << "== Bytecode VM vs native JIT (numeric expressions) ==" << std::endl;
+    JSONDocumentPtr document = JSONDocument::parse(R"({"price": 12.5, "qty": 4, "discount": 0.15, "tax": 0.2})");
+    Evaluator evaluator(document);
+    const char* expressions[] = {
+        "price * qty * (1 - discount) * (1 + tax)",
+        "max(price * qty - 10, 0) + abs(discount - tax) ** 2",
+        "1 + 2 * 3 - 4 / 5 + 6 * 7 - 8 + 9 * 10 - 11 / 12",
+    };
+    for (const char* expr : expressions) {
+        CompiledExpression compiled = CompiledExpression::compile(expr);
+        double vm = time_ns(100000, [&] { evaluator.evaluate(compiled); });
+        if (!compiled.enable_jit()) {
+            std::cout << expr << "\n\tvm " << vm << " ns/eval (no JIT on this platform)" << std::endl;
+            continue;
+        }
+        double jit = time_ns(100000, [&] { evaluator.evaluate(compiled); });
+        std::cout << expr << "\n\tvm " << vm << " ns/eval\tjit " << jit << " ns/eval" << std::endl;
+    }
+}
+
+void bench_thread_pool() {
+    std::cout << "== Parallel aggregate arguments by thread count ==" << std::endl;
+    std::string text = "{";
+    for (int k = 0; k < 8; ++k) {
+        text += (k ? ", \"a" : "\"a") + std::to_string(k) + "\": [";
+        for (int i = 0; i < 200000; ++i) text += (i ? ", " : "") + std::to_string(i % 97);
+        text += "]";
+    }
+    text += "}";
+    JSONDocumentPtr document = JSONDocument::parse(text);
+    CompiledExpression expr = CompiledExpression::compile(
+        "max(sum(a0), sum(a1), sum(a2), sum(a3), sum(a4), sum(a5), sum(a6), sum(a7))");
+    CompiledExpression trivial = CompiledExpression::compile("max(a0[0], a1[1], a2[2], a3[3])");
+
+    for (size_t threads : {0, 1, 2, 4, 8}) {
+        ThreadPool pool(threads);
+        Evaluator evaluator(document);
+        evaluator.set_thread_pool(&pool);
+        double heavy = time_ns(20, [&] { evaluator.evaluate(expr); });
+        double light = time_ns(10000, [&] { evaluator.evaluate(trivial); });
+        std::cout << "threads=" << threads << "\t8 x sum(200k) " << heavy / 1e6 << " ms\t"
+                  << "trivial args " << light << " ns" << std::endl;
+    }
+}
+
+void bench_reductions() {
+    std::cout << "== Reduction kernels over 1M doubles ==" << std::endl;
+    std::vector<double> values(1000000);
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<double>(i % 1000) * 0.5;
+    volatile double sink = 0;
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+        if (level > detected_simd_level()) continue;
+        double sum = time_ns(200, [&] { sink = reduce_sum(values.data(), values.size(), level); });
+        double min = time_ns(200, [&] { sink = reduce_min(values.data(), values.size(), level); });
+        std::cout << simd_level_name(level) << "\tsum " << sum / 1e3 << " us\tmin " << min / 1e3 << " us" << std::endl;
+    }
+    (void)sink;
+
+    std::string text = "{\"a\": [";
+    for (size_t i = 0; i < values.size(); ++i) text += (i ? ", " : "") + std::to_string(i % 1000);
+    text += "]}";
+    Evaluator evaluator(JSONDocument::parse(text));
+    CompiledExpression expr = CompiledExpression::compile("avg(a)");
+    double eval = time_ns(20, [&] { evaluator.evaluate(expr); });
+    std::cout << "avg(a) over 1M elements\t" << eval / 1e6 << " ms/eval" << std::endl;
+}
+
+void bench_arena() {
+    std::cout << "== Document parse and teardown: heap vs arena ==" << std::endl;
+    std::string text = make_document(100000);
+    for (JSONDocument::Allocation allocation : {JSONDocument::Heap, JSONDocument::Arena}) {
+        size_t before = allocations;
+        auto start = std::chrono::steady_clock::now();
+        JSONDocumentPtr document = JSONDocument::parse(text, allocation);
+        auto parsed = std::chrono::steady_clock::now();
+        size_t count = allocations - before;
+        document.reset();
+        auto freed = std::chrono::steady_clock::now();
+        std::cout << (allocation == JSONDocument::Arena ? "arena" : "heap") << "\t"
+                  << count << " allocations\tparse "
+                  << std::chrono::duration<double, std::milli>(parsed - start).count() << " ms\tteardown "
+                  << std::chrono::duration<double, std::milli>(freed - parsed).count() << " ms" << std::endl;
+    }
+}
+
+void bench_file_input() {
+    std::cout << "== Loading a file: stream copies vs mmap ==" << std::endl;
+    const std::string path = "bench_input.json";
+    std::string text = make_document(300000);
+    {
+        std::ofstream out(path);
+        out << text;
+    }
+    // Both variants touch every byte, as the parser would
+    volatile size_t sink = 0;
+    double streamed = time_ns(5, [&] {
+        std::ifstream file(path);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        std::string content = buffer.str();
+        size_t sum = 0;
+        for (char c : content) sum += static_cast<unsigned char>(c);
+        sink = sum;
+    });
+    double mapped = time_ns(5, [&] {
+        MappedFile file(path);
+        size_t sum = 0;
+        for (char c : file.view()) sum += static_cast<unsigned char>(c);
+        sink = sum;
+    });
+    (void)sink;
+    std::remove(path.c_str());
+    std::cout << text.size() / (1 << 20) << " MiB\tifstream+stringstream " << streamed / 1e6 << " ms\tmmap "
+              << mapped / 1e6 << " ms" << std::endl;
+}
+
+// Log-like document: an array of records with short strings, numbers and nested objects
+std::string make_log_document(size_t records) {
+    std::string text = "[\n";
+    for (size_t i = 0; i < records; ++i) {
+        if (i) text += ",\n";
+        text += R"(  {"ts": )" + std::to_string(1700000000 + i) + R"(, "level": "info", "msg": "request handled \"ok\"", )"
+              + R"("http": {"status": 200, "path": "/api/v1/items/)" + std::to_string(i % 977) + R"(", "ms": 12.5}, "tags": ["a", "b"]})";
+    }
+    text += "\n]";
+    return text;
+}
+
+void bench_structural_parser() {
+    std::cout << "== Parser throughput: character vs structural index ==" << std::endl;
+    std::string text = make_log_document(100000);
+    double mb = text.size() / 1e6;
+    double character = time_ns(5, [&] { JSON::parse(text); });
+    double stage1 = time_ns(5, [&] { StructuralParser::index(text); });
+    double structural = time_ns(5, [&] { StructuralParser::parse(text); });
+    std::cout << "character\t" << mb / (character / 1e9) << " MB/s" << std::endl;
+    std::cout << "structural\t" << mb / (structural / 1e9) << " MB/s (stage 1 alone "
+              << mb / (stage1 / 1e9) << " MB/s, " << simd_level_name(detected_simd_level()) << ")" << std::endl;
+}
+
+void bench_number_parsing() {
+    std::cout << "== Number parsing: substr + stod vs parse_json_number ==" << std::endl;
+    // Numeric-heavy corpus: integers, prices, coordinates and exponents
+    std::vector<std::string> tokens;
+    std::string text = "[";
+    for (size_t i = 0; i < 500000; ++i) {
+        std::string token;
+        switch (i % 4) {
+            case 0: token = std::to_string(i * 7919); break;
+            case 1: token = std::to_string(i % 10000) + "." + std::to_string(i % 100); break;
+            case 2: token = "-" + std::to_string(i % 180) + "." + std::to_string(1000000 + i * 31); break;
+            default: token = std::to_string(i % 9 + 1) + "." + std::to_string(i % 1000) + "e" + std::to_string(static_cast<int>(i % 30) - 15); break;
+        }
+        text += (i ? ", " : "") + token;
+        tokens.push_back(token);
+    }
+    text += "]";
+
+    volatile double sink = 0;
+    double stod = time_ns(5, [&] {
+        double sum = 0;
+        for (const std::string& token : tokens) sum += std::stod(token.substr(0));
+        sink = sum;
+    });
+    double fast = time_ns(5, [&] {
+        double sum = 0;
+        ParsedNumber number;
+        for (const std::string& token : tokens) {
+            parse_json_number(token.data(), token.data() + token.size(), number);
+            sum += number.number;
+        }
+        sink = sum;
+    });
+    (void)sink;
+    std::cout << "stod " << stod / tokens.size() << " ns/number\tparse_json_number " << fast / tokens.size()
+              << " ns/number" << std::endl;
+    double parse = time_ns(5, [&] { JSON::parse(text); });
+    std::cout << "numeric document " << text.size() / 1e6 / (parse / 1e9) << " MB/s" << std::endl;
+}
+
+void bench_number_formatting() {
+    std::cout << "== Number formatting: ostringstream vs shortest round trip ==" << std::endl;
+    std::vector<double> values;
+    for (size_t i = 0; i < 1000000; ++i) values.push_back(i % 3 ? i * 0.37 : static_cast<double>(i));
+    volatile size_t sink = 0;
+    double stream = time_ns(3, [&] {
+        size_t length = 0;
+        for (double v : values) {
+            std::ostringstream oss;
+            oss << v;
+            length += oss.str().size();
+        }
+        sink = length;
+    });
+    double shortest = time_ns(3, [&] {
+        size_t length = 0;
+        char buffer[MAX_NUMBER_LENGTH];
+        for (double v : values) length += static_cast<size_t>(format_json_number(v, buffer) - buffer);
+        sink = length;
+    });
+    (void)sink;
+    std::cout << "ostringstream " << stream / values.size() << " ns/number (6 significant digits)\t"
+              << "format_json_number " << shortest / values.size() << " ns/number (lossless)" << std::endl;
+    JSONValue array(JSONNumberArray(values.begin(), values.end()));
+    double dump = time_ns(3, [&] { sink = array.to_string().size(); });
+    std::cout << "to_string of 1M numbers " << dump / 1e6 << " ms" << std::endl;
+}
+
+void bench_writer() {
+    std::cout << "== Serializing 100k records ==" << std::endl;
+    JSONDocumentPtr document = JSONDocument::parse(make_log_document(100000));
+    JSONWriter compact;
+    JSONWriter pretty(JSONWriter::Pretty);
+    double compact_ns = time_ns(5, [&] { compact.clear(); compact.write(document->root()); });
+    double pretty_ns = time_ns(5, [&] { pretty.clear(); pretty.write(document->root()); });
+    std::FILE* null_device = std::fopen("/dev/null", "w");
+    size_t peak = 0;
+    double streamed_ns = time_ns(5, [&] {
+        JSONWriter streaming(fileno(null_device), JSONWriter::Compact);
+        streaming.write(document->root());
+        peak = std::max(peak, streaming.str().capacity());
+    });
+    std::fclose(null_device);
+    double mb = compact.str().size() / 1e6;
+    std::cout << "compact " << mb / (compact_ns / 1e9) << " MB/s\tpretty " << pretty.str().size() / 1e6 / (pretty_ns / 1e9)
+              << " MB/s\tto /dev/null " << mb / (streamed_ns / 1e9) << " MB/s with a " << peak / 1024 << " KiB buffer" << std::endl;
+}
+
+// String-heavy corpus: long log messages with the odd escape and non-ASCII text
+std::string make_string_document(size_t records) {
+    std::string text = "[";
+    for (size_t i = 0; i < records; ++i) {
+        text += i ? ", \"" : "\"";
+        text += "user " + std::to_string(i) + " requested /api/v1/items?page=" + std::to_string(i % 50)
+              + " from caf\xC3\xA9 client, upstream said \\\"retry later\\\" after a 120 ms timeout";
+        text += "\"";
+    }
+    text += "]";
+    return text;
+}
+
+void bench_strings() {
+    std::cout << "== String decoding: per-character loop vs SIMD scan ==" << std::endl;
+    std::string text = make_string_document(100000);
+    double mb = text.size() / 1e6;
+
+    // What read_string did before: one append per character
+    auto per_character = [](const char* p, const char* end, JSONString& out) {
+        while (p != end && *p != '"') {
+            char c = *p++;
+            if (c == '\\' && p != end) {
+                c = *p++;
+                if (c == 'n') c = '\n';
+            }
+            out += c;
+        }
+        return p + 1;
+    };
+    auto scan = [&](auto decode) {
+        size_t length = 0;
+        JSONString out;
+        const char* end = text.data() + text.size();
+        for (const char* p = text.data(); (p = static_cast<const char*>(std::memchr(p, '"', end - p))); ) {
+            out.clear();
+            p = decode(p + 1, end, out);
+            length += out.size();
+        }
+        return length;
+    };
+    volatile size_t sink = 0;
+    double loop = time_ns(5, [&] { sink = scan(per_character); });
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+        if (level > detected_simd_level()) continue;
+        double simd = time_ns(5, [&] {
+            sink = scan([&](const char* p, const char* end, JSONString& out) { return parse_json_string(p, end, out, level); });
+        });
+        std::cout << simd_level_name(level) << " " << mb / (simd / 1e9) << " MB/s\t";
+    }
+    (void)sink;
+    std::cout << "per-character " << mb / (loop / 1e9) << " MB/s (no validation)" << std::endl;
+    double parse = time_ns(5, [&] { JSON::parse(text); });
+    std::cout << "string document " << mb / (parse / 1e9) << " MB/s" << std::endl;
+}
+
+void bench_lazy_strings() {
+    std::cout << "== String-heavy document: decoded vs lazy strings ==" << std::endl;
+    std::string text = make_string_document(200000);
+    for (JSONDocument::Strings strings : {JSONDocument::Decoded, JSONDocument::Lazy}) {
+        size_t count = allocations, bytes = allocated_bytes;
+        auto start = std::chrono::steady_clock::now();
+        JSONDocumentPtr document = JSONDocument::parse(text, JSONDocument::Heap, JSONDocument::Character, strings);
+        auto parsed = std::chrono::steady_clock::now();
+        count = allocations - count;
+        bytes = allocated_bytes - bytes;
+        size_t length = 0;
+        for (const JSONValue& item : document->root().as_array()) length += item.as_string().size();
+        auto read = std::chrono::steady_clock::now();
+        std::cout << (strings == JSONDocument::Lazy ? "lazy" : "decoded") << "\tparse "
+                  << std::chrono::duration<double, std::milli>(parsed - start).count() << " ms, " << count
+                  << " allocations, " << bytes / (1 << 20) << " MiB\treading every string "
+                  << std::chrono::duration<double, std::milli>(read - parsed).count() << " ms (" << length / (1 << 20)
+                  << " MiB)" << std::endl;
+    }
+}
+
+void bench_object_lookup() {
+    std::cout << "== Key lookup by object size: std::map vs flat/hashed JSONObject ==" << std::endl;
+    for (size_t size : {2, 8, 16, 64, 1024, 65536}) {
+        std::string text = "{";
+        std::vector<std::string> keys;
+        for (size_t i = 0; i < size; ++i) {
+            keys.push_back("field_" + std::to_string(i * 7919 % 100003));
+            text += (i ? ", \"" : "\"") + keys.back() + "\": " + std::to_string(i);
+        }
+        text += "}";
+        JSONValue value = JSON::parse(text);
+        const JSONObject& object = value.as_object();
+        std::map<std::string, JSONValue, std::less<>> map;
+        for (const auto& member : object) map.emplace(std::string(member.first->name), member.second);
+
+        // Walk the keys in a scattered order so neither layout is helped by the cache
+        std::vector<std::string_view> order;
+        for (size_t i = 0; i < 1000000; ++i) order.push_back(keys[i * 2654435761u % size]);
+        volatile int64_t sink = 0;
+        double tree = time_ns(1, [&] {
+            int64_t total = 0;
+            for (std::string_view key : order) total += map.find(key)->second.as_integer();
+            sink = total;
+        });
+        double flat = time_ns(1, [&] {
+            int64_t total = 0;
+            for (std::string_view key : order) total += object.find(key)->second.as_integer();
+            sink = total;
+        });
+        (void)sink;
+        std::cout << size << " keys\tmap " << tree / order.size() << " ns\t" << (size < JSONShape::HASHED_SIZE ? "sorted " : "hashed ")
+                  << flat / order.size() << " ns" << std::endl;
+    }
+}
+
+void bench_key_interning() {
+    std::cout << "== Record keys interned per document ==" << std::endl;
+    std::string text = make_log_document(100000);
+    size_t count = allocations, bytes = allocated_bytes;
+    JSONDocumentPtr document = JSONDocument::parse(text);
+    std::cout << "heap parse " << allocations - count << " allocations, " << (allocated_bytes - bytes) / (1 << 20)
+              << " MiB for " << text.size() / (1 << 20) << " MiB of input, " << document->keys().size()
+              << " distinct keys" << std::endl;
+
+    const JSONArray& records = document->root().as_array();
+    const JSONKey* level = document->keys().find("level");
+    volatile size_t sink = 0;
+    double by_name = time_ns(10, [&] {
+        size_t found = 0;
+        for (const JSONValue& record : records) found += record.as_object().count("level");
+        sink = found;
+    });
+    double by_key = time_ns(10, [&] {
+        size_t found = 0;
+        for (const JSONValue& record : records) {
+            const JSONObject& object = record.as_object();
+            found += object.find(level) != object.end();
+        }
+        sink = found;
+    });
+    (void)sink;
+    std::cout << "lookup by name " << by_name / records.size() << " ns\tby interned key " << by_key / records.size()
+              << " ns" << std::endl;
+}
+
+void bench_shapes() {
+    std::cout << "== Path lookup through the shape cache ==" << std::endl;
+    // Same-shaped records; the second document puts price in another slot of another shape
+    std::string first = "{\"items\":[", second = "{\"items\":[";
+    for (int i = 0; i < 1000; ++i) {
+        std::string n = std::to_string(i);
+        first += (i ? "," : "") + std::string("{\"id\":") + n + ",\"name\":\"r" + n + "\",\"price\":" + n + ",\"qty\":2}";
+        second += (i ? "," : "") + std::string("{\"a\":0,\"id\":") + n + ",\"price\":" + n + "}";
+    }
+    first += "]}";
+    second += "]}";
+    Evaluator a(JSONDocument::parse(first)), b(JSONDocument::parse(second));
+    std::vector<CompiledExpression> paths;
+    for (int i = 0; i < 1000; ++i) paths.push_back(CompiledExpression::compile("items[" + std::to_string(i) + "].price"));
+    std::cout << "shapes: " << a.get_document()->keys().shape_count() << " for 1000 records" << std::endl;
+
+    volatile double sink = 0;
+    double hit = time_ns(200, [&] {
+        for (const CompiledExpression& path : paths) sink = sink + a.evaluate(path).as_number();
+    });
+    double miss = time_ns(100, [&] {
+        for (const CompiledExpression& path : paths) sink = sink + a.evaluate(path).as_number() + b.evaluate(path).as_number();
+    }) / 2;
+    (void)sink;
+    std::cout << "cached slot " << hit / paths.size() << " ns\tshape changed every time " << miss / paths.size()
+              << " ns per evaluation" << std::endl;
+}
+
+// Every value in a tree, numbers of packed arrays included
+static size_t count_nodes(const JSONValue& value) {
+    size_t nodes = 1;
+    if (value.is_number_array()) {
+        nodes += value.array_size();
+    } else if (value.is_array()) {
+        for (const JSONValue& item : value.as_array()) nodes += count_nodes(item);
+    } else if (value.is_object()) {
+        for (const auto& member : value.as_object()) nodes += count_nodes(member.second);
+    }
+    return nodes;
+}
+
+void bench_value_size() {
+    std::cout << "== Memory per node, sizeof(JSONValue) = " << sizeof(JSONValue) << " ==" << std::endl;
+    std::pair<const char*, std::string> corpora[] = {{"records", make_document(100000)},
+                                                     {"log", make_log_document(100000)},
+                                                     {"strings", make_string_document(200000)}};
+    for (const auto& corpus : corpora) {
+        size_t count = allocations, bytes = allocated_bytes;
+        auto start = std::chrono::steady_clock::now();
+        JSONDocumentPtr document = JSONDocument::parse(corpus.second);
+        auto parsed = std::chrono::steady_clock::now();
+        count = allocations - count;
+        bytes = allocated_bytes - bytes;
+        size_t nodes = count_nodes(document->root());
+        std::cout << corpus.first << "\t" << nodes << " nodes, " << static_cast<double>(bytes) / nodes << " bytes and "
+                  << static_cast<double>(count) / nodes << " allocations per node, parse "
+                  << std::chrono::duration<double, std::milli>(parsed - start).count() << " ms" << std::endl;
+    }
+}
+
+// Records nested `depth` levels deep, alternating objects and arrays
+std::string make_nested_document(size_t records, size_t depth) {
+    std::string record;
+    for (size_t i = 0; i < depth; ++i) record += i % 2 ? "[1, " : R"({"id": 7, "next": )";
+    record += "null";
+    for (size_t i = depth; i-- > 0;) record += i % 2 ? "]" : "}";
+    std::string text = "[";
+    for (size_t i = 0; i < records; ++i) text += (i ? ",\n" : "") + record;
+    return text + "]";
+}
+
+void bench_nesting() {
+    std::cout << "== Nesting-heavy documents ==" << std::endl;
+    for (size_t depth : {8, 100, 1000}) {
+        std::string text = make_nested_document(2000000 / depth, depth);
+        double mb = text.size() / 1e6;
+        double character = time_ns(5, [&] { JSONDocument::parse(text, JSONDocument::Arena); });
+        double structural = time_ns(5, [&] { JSONDocument::parse(text, JSONDocument::Arena, JSONDocument::Structural); });
+        std::cout << "depth " << depth << "\tcharacter " << mb / (character / 1e9) << " MB/s\tstructural "
+                  << mb / (structural / 1e9) << " MB/s" << std::endl;
+    }
+    std::string brackets(10000000, '[');
+    double rejected = time_ns(5, [&] {
+        try {
+            JSON::parse(brackets);
+        } catch (const JSONError&) {
+        }
+    });
+    std::cout << "10M '[' rejected at depth " << JSON_MAX_DEPTH << " in " << rejected / 1e3 << " us" << std::endl;
+}
+
+// Sums http.status over log records from events, keeping nothing else
+class StatusSum : public JSONHandler {
+    size_t depth = 0;
+    bool in_http = false, in_status = false;
+public:
+    int64_t total = 0;
+    bool start_object() override { ++depth; return true; }
+    bool end_object() override {
+        if (--depth == 1) in_http = false;
+        return true;
+    }
+    bool key(std::string_view k) override {
+        if (depth == 1) in_http = k == "http";
+        in_status = in_http && depth == 2 && k == "status";
+        return true;
+    }
+    bool integer(int64_t i) override {
+        if (in_status) total += i;
+        return true;
+    }
+};
+
+void bench_events() {
+    std::cout << "== Extracting one field: tree vs events ==" << std::endl;
+    std::string text = make_log_document(100000);
+    double mb = text.size() / 1e6;
+    int64_t from_tree = 0, from_events = 0;
+    size_t count = allocations, bytes = allocated_bytes;
+    double tree = time_ns(5, [&] {
+        JSONDocumentPtr document = JSONDocument::parse(text);
+        from_tree = 0;
+        for (const JSONValue& record : document->root().as_array()) {
+            from_tree += record.as_object().at("http").as_object().at("status").as_integer();
+        }
+    });
+    size_t tree_allocations = (allocations - count) / 5, tree_bytes = (allocated_bytes - bytes) / 5;
+    count = allocations;
+    bytes = allocated_bytes;
+    double events = time_ns(5, [&] {
+        StatusSum sum;
+        JSON::parse_events(text, sum);
+        from_events = sum.total;
+    });
+    std::cout << "tree " << mb / (tree / 1e9) << " MB/s, " << tree_allocations << " allocations, " << tree_bytes / (1 << 20)
+              << " MiB\tevents " << mb / (events / 1e9) << " MB/s, " << (allocations - count) / 5 << " allocations, "
+              << (allocated_bytes - bytes) / 5 << " bytes" << (from_tree == from_events ? "" : " MISMATCH") << std::endl;
+}
+
+// The log records as NDJSON, one per line
+static std::string make_log_lines(size_t records) {
+    std::string array = make_log_document(records), lines;
+    lines.reserve(array.size());
+    for (size_t i = 2; i + 2 < array.size(); ++i) {
+        if (array[i] == ',' && array[i + 1] == '\n') continue; // The separator between records
+        lines += array[i];
+    }
+    return lines + "\n";
+}
+
+void bench_stream() {
+    std::cout << "== Chunked input: 64 KiB chunks through JSONStream vs one document ==" << std::endl;
+    std::string array = make_log_document(100000), lines = make_log_lines(100000);
+    double mb = lines.size() / 1e6;
+    const size_t chunk = 1 << 16;
+    double whole = time_ns(5, [&] { JSONDocument::parse(array); });
+    size_t documents = 0;
+    double streamed = time_ns(5, [&] {
+        JSONStream stream;
+        documents = 0;
+        for (size_t i = 0; i < lines.size(); i += chunk) {
+            stream.feed(std::string_view(lines).substr(i, chunk));
+            while (stream.next_document()) ++documents;
+        }
+        stream.finish();
+        while (stream.next_document()) ++documents;
+    });
+    int64_t from_events = 0;
+    double events = time_ns(5, [&] {
+        JSONStream stream;
+        StatusSum sum;
+        for (size_t i = 0; i < lines.size(); i += chunk) {
+            stream.feed(std::string_view(lines).substr(i, chunk));
+            while (stream.next_events(sum)) {
+            }
+        }
+        from_events = sum.total;
+    });
+    // The first record is usable after one chunk instead of after the whole input
+    double first = time_ns(20, [&] {
+        JSONStream stream;
+        stream.feed(std::string_view(lines).substr(0, chunk));
+        stream.next_document();
+    });
+    std::cout << "whole document " << mb / (whole / 1e9) << " MB/s\tstream documents " << mb / (streamed / 1e9)
+              << " MB/s (" << documents << ")\tstream events " << mb / (events / 1e9) << " MB/s"
+              << (from_events == 200 * 100000 ? "" : " MISMATCH") << std::endl;
+    std::cout << "first record after " << first / 1e3 << " us, whole document after " << whole / 1e3 << " us" << std::endl;
+}
+
+void bench_ndjson() {
+    std::cout << "== NDJSON records: one compiled expression per record ==" << std::endl;
+    std::string lines = make_log_lines(100000);
+    CompiledExpression expr = CompiledExpression::compile("http.ms * 2 + http.status");
+    for (auto keys : {JSONStream::Separate, JSONStream::Shared}) {
+        for (auto allocation : {JSONDocument::Heap, JSONDocument::Arena}) {
+            double total = 0;
+            size_t count = allocations;
+            double ns = time_ns(5, [&] {
+                JSONStream stream(JSONStream::Lines, keys);
+                Evaluator evaluator(std::make_shared<const JSONDocument>(JSONValue(nullptr)));
+                JSONWriter writer;
+                total = 0;
+                for (size_t i = 0; i < lines.size(); i += 1 << 16) {
+                    stream.feed(std::string_view(lines).substr(i, 1 << 16));
+                    while (JSONDocumentPtr document = stream.next_document(allocation)) {
+                        evaluator.set_document(std::move(document));
+                        JSONValue result = evaluator.evaluate(expr);
+                        total += result.as_number();
+                        writer.write(result);
+                        writer.write_raw("\n");
+                    }
+                    writer.clear();
+                }
+            });
+            std::cout << (keys == JSONStream::Shared ? "shared keys" : "separate keys") << ", "
+                      << (allocation == JSONDocument::Arena ? "arena" : "heap") << "\t" << ns / 100000 << " ns/record, "
+                      << (allocations - count) / 5 / 100000.0 << " allocations/record"
+                      << (total == 100000 * 225.0 ? "" : " MISMATCH") << std::endl;
+        }
+    }
+}
+
+int main() {
+    bench_path_lookup();
+    bench_shared_document();
+    bench_compiled_expression();
+    bench_tree_vs_vm();
+    bench_jit();
+    bench_thread_pool();
+    bench_reductions();
+    bench_arena();
+    bench_file_input();
+    bench_structural_parser();
+    bench_number_parsing();
+    bench_number_formatting();
+    bench_writer();
+    bench_strings();
+    bench_lazy_strings();
+    bench_object_lookup();
+    bench_key_interning();
+    bench_shapes();
+    bench_value_size();
+    bench_nesting();
+    bench_events();
+    bench_stream();
+    bench_ndjson();
+    return 0;
+}
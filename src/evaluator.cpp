@@ -1,355 +1,329 @@
 #include "evaluator.h"
-#include <sstream>
+#include "jit.h"
 #include <cctype>
 #include <algorithm>
 #include <limits>
-#include <future> // For std::async and std::future
+#include "reduce.h"
+#include "thread_pool.h"
 #include <cmath>  // For abs, round, pow
-#include <iostream> // For std::cout and std::endl
 
-JSONValue Evaluator::evaluate(const std::string& expr) {
-    return evaluate_expression(expr);
+Operand Operand::of_value(const JSONValue& value) {
+    if (value.is_integer()) {
+        Operand o = of_number(value.as_number());
+        o.ref = &value; // Materialized from the source, so large integers stay exact
+        return o;
+    }
+    if (value.is_number()) return of_number(value.as_number());
+    if (value.is_bool()) return of_bool(value.as_bool());
+    if (value.is_null()) return Operand();
+    Operand o;
+    o.kind = Ref;
+    o.ref = &value;
+    return o;
 }
 
-std::vector<std::string> Evaluator::parse_arguments(const std::string& args_str) {
-    std::vector<std::string> args;
-    size_t start = 0;
-    int depth = 0;
-    for (size_t i = 0; i < args_str.length(); ++i) {
-        if (args_str[i] == '(') {
-            depth++;
-        } else if (args_str[i] == ')') {
-            depth--;
-        } else if (args_str[i] == ',' && depth == 0) {
-            args.push_back(args_str.substr(start, i - start));
-            start = i + 1;
+static bool has_packed(const JSONValue& value) {
+    if (value.is_number_array()) return true;
+    if (value.is_array()) {
+        for (const JSONValue& element : value.as_array()) {
+            if (has_packed(element)) return true;
+        }
+    } else if (value.is_object()) {
+        for (const auto& member : value.as_object()) {
+            if (has_packed(member.second)) return true;
         }
     }
-    // Add the final argument
-    args.push_back(args_str.substr(start));
-    return args;
+    return false;
 }
 
-
-JSONValue Evaluator::evaluate_expression(const std::string& expr) {
-    // Trim whitespace from both ends
-    std::string trimmed_expr = expr;
-    trimmed_expr.erase(0, trimmed_expr.find_first_not_of(" \t\n\r"));
-    trimmed_expr.erase(trimmed_expr.find_last_not_of(" \t\n\r") + 1);
-
-    // Check for functions (e.g., "max(...)", "min(...)", etc.)
-    size_t func_pos = trimmed_expr.find('(');
-    if (func_pos != std::string::npos && func_pos > 0) {
-        // Look for matching closing bracket for the function call
-        size_t end_pos = find_matching_bracket(trimmed_expr, func_pos);
-        if (end_pos != std::string::npos) {
-            std::string func_name = trimmed_expr.substr(0, func_pos);
-            std::string args_str = trimmed_expr.substr(func_pos + 1, end_pos - func_pos - 1);
-
-            // Parse arguments by splitting on commas, respecting nested expressions
-            std::vector<std::string> args = parse_arguments(args_str);
-
-            // Evaluate the function call
-            return evaluate_function(func_name, args);
-        }
+// A copy of value with its packed arrays unpacked. Subtrees without any are copied as they are.
+static JSONValue unpacked(const JSONValue& value) {
+    if (value.is_number_array()) {
+        const JSONNumberArray& numbers = value.as_number_array();
+        return JSONValue(JSONArray(numbers.begin(), numbers.end()));
     }
-
-    // Check for specific binary operators (in descending order of precedence)
-    if (expr.find("**") != std::string::npos) {
-        size_t pos = expr.find("**");
-        std::string left_expr = expr.substr(0, pos);
-        std::string right_expr = expr.substr(pos + 2);
-        JSONValue left = evaluate_expression(left_expr);
-        JSONValue right = evaluate_expression(right_expr);
-
-        if (!left.is_number() || !right.is_number()) throw EvalError("** requires numeric operands");
-        return JSONValue(std::pow(left.as_number(), right.as_number()));
+    if (!has_packed(value)) return value;
+    if (value.is_array()) {
+        JSONArray array;
+        array.reserve(value.array_size());
+        for (const JSONValue& element : value.as_array()) array.push_back(unpacked(element));
+        return JSONValue(std::move(array));
     }
+    JSONObject object = value.as_object(); // Same shape; existing keys are assigned in place
+    for (const auto& member : value.as_object()) {
+        if (has_packed(member.second)) object.insert_or_assign(member.first->name, unpacked(member.second));
+    }
+    return JSONValue(std::move(object));
+}
 
-    if (expr.find("&&") != std::string::npos) {
-        size_t pos = expr.find("&&");
-        std::string left_expr = expr.substr(0, pos);
-        std::string right_expr = expr.substr(pos + 2);
-        JSONValue left = evaluate_expression(left_expr);
-        JSONValue right = evaluate_expression(right_expr);
-
-        return JSONValue(left.as_number() && right.as_number());
+JSONValue Operand::materialize() const {
+    switch (kind) {
+        case Bool: return JSONValue(boolean);
+        case Number: return ref ? *ref : JSONValue(number);
+        case Ref: return unpacked(*ref);
+        default: return JSONValue(nullptr);
     }
+}
 
-    if (expr.find("||") != std::string::npos) {
-        size_t pos = expr.find("||");
-        std::string left_expr = expr.substr(0, pos);
-        std::string right_expr = expr.substr(pos + 2);
-        JSONValue left = evaluate_expression(left_expr);
-        JSONValue right = evaluate_expression(right_expr);
+bool Evaluator::truthy(const Operand& operand) {
+    if (operand.kind == Operand::Bool) return operand.boolean;
+    if (operand.kind == Operand::Number) return operand.number != 0;
+    throw EvalError("Logical operations require boolean or numeric operands");
+}
 
-        return JSONValue(left.as_number() || right.as_number());
-    }
+Evaluator::Evaluator(JSONDocumentPtr doc) : document(std::move(doc)) {
+    if (!document) throw EvalError("Evaluator requires a document");
+}
 
-    // Handle modulus
-    size_t pos = expr.find('%');
-    if (pos != std::string::npos) {
-        std::string left_expr = expr.substr(0, pos);
-        std::string right_expr = expr.substr(pos + 1);
-        JSONValue left = evaluate_expression(left_expr);
-        JSONValue right = evaluate_expression(right_expr);
+void Evaluator::set_document(JSONDocumentPtr doc) {
+    if (!doc) throw EvalError("Evaluator requires a document");
+    document = std::move(doc);
+}
 
-        if (!left.is_number() || !right.is_number()) throw EvalError("% requires numeric operands");
-        return JSONValue(static_cast<double>(static_cast<int>(left.as_number()) % static_cast<int>(right.as_number())));
-    }
+JSONValue Evaluator::evaluate(const std::string& expr) const {
+    return evaluate(CompiledExpression::compile(expr));
+}
 
-    // Check for basic arithmetic operators
-    pos = expr.find_first_of("+-*/");
-    if (pos != std::string::npos) {
-        char op = expr[pos];
-        std::string left_expr = expr.substr(0, pos);
-        std::string right_expr = expr.substr(pos + 1);
+JSONValue Evaluator::evaluate(const CompiledExpression& expr) const {
+    double result;
+    if (expr.get_jit() && run_jit(*expr.get_jit(), result)) return JSONValue(result);
+    return execute(expr.get_program()).materialize();
+}
 
-        JSONValue left = evaluate_expression(left_expr);
-        JSONValue right = evaluate_expression(right_expr);
+bool Evaluator::run_jit(const NumericJIT& jit, double& result) const {
+    const std::vector<JSONPath>& slots = jit.get_slots();
+    double inline_values[16];
+    std::vector<double> heap_values;
+    double* values = inline_values;
+    if (slots.size() > 16) {
+        heap_values.resize(slots.size());
+        values = heap_values.data();
+    }
 
-        if (!left.is_number() || !right.is_number()) {
-            throw EvalError("Arithmetic operations require numeric operands");
+    // Bind each path to its slot; anything unusual is left to the VM, which reports it
+    for (size_t i = 0; i < slots.size(); ++i) {
+        Operand value;
+        try {
+            value = resolve_path(slots[i]);
+        } catch (const EvalError&) {
+            return false;
         }
+        if (value.kind != Operand::Number) return false;
+        values[i] = value.number;
+    }
+    return jit.run(values, result);
+}
 
-        double l = left.as_number();
-        double r = right.as_number();
-        switch (op) {
-            case '+': return JSONValue(l + r);
-            case '-': return JSONValue(l - r);
-            case '*': return JSONValue(l * r);
-            case '/':
-                if (r == 0) throw EvalError("Division by zero");
-                return JSONValue(l / r);
+JSONValue Evaluator::evaluate_tree(const CompiledExpression& expr) const {
+    return evaluate_node(expr.get_root()).materialize();
+}
+
+Operand Evaluator::evaluate_node(const ExprNode& node) const {
+    switch (node.kind) {
+        case ExprNode::Number: return Operand::of_number(node.number);
+        case ExprNode::Bool: return Operand::of_bool(node.boolean);
+        case ExprNode::Null: return Operand();
+        case ExprNode::Path: return resolve_path(node.path);
+        case ExprNode::Call: return evaluate_function(node);
+        case ExprNode::Binary: return evaluate_binary(node);
+        case ExprNode::Unary: {
+            Operand operand = evaluate_node(*node.children[0]);
+            if (node.op == Operator::Not) return Operand::of_bool(!truthy(operand));
+            if (operand.kind != Operand::Number) throw EvalError("Unary '-' requires a numeric operand");
+            return Operand::of_number(-operand.number);
         }
     }
-
-    // Fallback to JSON path evaluation if no operators or functions are found
-    return evaluate_json_path(trimmed_expr);
+    throw EvalError("Invalid expression node");
 }
 
+Operand Evaluator::evaluate_binary(const ExprNode& node) const {
+    // Logical operators short-circuit on the left operand
+    if (node.op == Operator::And || node.op == Operator::Or) {
+        bool left = truthy(evaluate_node(*node.children[0]));
+        if (node.op == Operator::And && !left) return Operand::of_bool(false);
+        if (node.op == Operator::Or && left) return Operand::of_bool(true);
+        return Operand::of_bool(truthy(evaluate_node(*node.children[1])));
+    }
+    // Left first, as in the VM, so both report the same error when both sides fail
+    Operand left = evaluate_node(*node.children[0]);
+    return apply_arithmetic(node.op, left, evaluate_node(*node.children[1]));
+}
 
-JSONValue Evaluator::evaluate_function(const std::string& func_name, const std::vector<std::string>& args) {
-    if (func_name == "min") {
-        double min_value = std::numeric_limits<double>::infinity();
+Operand Evaluator::apply_arithmetic(Operator op, const Operand& left, const Operand& right) {
+    if (left.kind != Operand::Number || right.kind != Operand::Number) {
+        if (op == Operator::Pow) throw EvalError("** requires numeric operands");
+        if (op == Operator::Mod) throw EvalError("% requires numeric operands");
+        throw EvalError("Arithmetic operations require numeric operands");
+    }
 
-        // Launch async tasks to evaluate each argument concurrently
-        std::vector<std::future<JSONValue>> futures;
-        for (const auto& arg : args) {
-            futures.push_back(std::async(&Evaluator::evaluate_expression, this, arg));
-        }
+    double l = left.number;
+    double r = right.number;
+    switch (op) {
+        case Operator::Add: return Operand::of_number(l + r);
+        case Operator::Sub: return Operand::of_number(l - r);
+        case Operator::Mul: return Operand::of_number(l * r);
+        case Operator::Div:
+            if (r == 0) throw EvalError("Division by zero");
+            return Operand::of_number(l / r);
+        case Operator::Mod:
+            if (std::trunc(r) == 0) throw EvalError("Division by zero");
+            return Operand::of_number(truncated_mod(l, r));
+        case Operator::Pow: return Operand::of_number(std::pow(l, r));
+        default: throw EvalError("Invalid binary operator");
+    }
+}
 
-        // Collect results and find the minimum value
-        for (auto& future : futures) {
-            JSONValue val = future.get();
-            if (val.is_array()) {
-                for (const auto& item : val.as_array()) {
-                    if (!item.is_number()) throw EvalError("min requires numeric values");
-                    min_value = std::min(min_value, item.as_number());
-                }
-            } else if (val.is_number()) {
-                min_value = std::min(min_value, val.as_number());
-            } else {
-                throw EvalError("min requires numeric values");
-            }
-        }
-        if (min_value == std::numeric_limits<double>::infinity()) throw EvalError("min requires at least one numeric value");
-        return JSONValue(min_value);
-    } else if (func_name == "max") {
-        double max_value = -std::numeric_limits<double>::infinity();
+Operand Evaluator::evaluate_function(const ExprNode& node) const {
+    std::vector<Operand> args(node.children.size());
+    std::vector<size_t> costs;
+    for (const auto& arg : node.children) costs.push_back(arg->cost);
+    dispatch_arguments(costs, [&](size_t i) { args[i] = evaluate_node(*node.children[i]); });
+    return call_function(node.function, args.data(), args.size());
+}
 
-        // Launch async tasks to evaluate each argument concurrently
-        std::vector<std::future<JSONValue>> futures;
-        for (const auto& arg : args) {
-            futures.push_back(std::async(&Evaluator::evaluate_expression, this, arg));
-        }
+void Evaluator::dispatch_arguments(const std::vector<size_t>& costs, const std::function<void(size_t)>& fn) const {
+    std::vector<size_t> expensive;
+    for (size_t i = 0; i < costs.size(); ++i) {
+        if (costs[i] >= parallel_threshold) expensive.push_back(i);
+        else fn(i);
+    }
+    if (expensive.size() < 2) {
+        for (size_t i : expensive) fn(i);
+        return;
+    }
+    ThreadPool& workers = pool ? *pool : ThreadPool::shared();
+    workers.parallel_for(expensive.size(), [&](size_t k) { fn(expensive[k]); });
+}
 
-        // Collect results and find the maximum value
-        for (auto& future : futures) {
-            JSONValue val = future.get();
-            if (val.is_array()) {
-                for (const auto& item : val.as_array()) {
-                    if (!item.is_number()) throw EvalError("max requires numeric values");
-                    max_value = std::max(max_value, item.as_number());
-                }
-            } else if (val.is_number()) {
-                max_value = std::max(max_value, val.as_number());
+Operand Evaluator::call_function(Function function, const Operand* args, size_t argc) {
+    const char* name = function_name(function);
+
+    switch (function) {
+        case Function::Min:
+        case Function::Max:
+        case Function::Sum:
+        case Function::Avg: {
+            // A lone packed array is reduced in place. Anything else is gathered into one
+            // contiguous buffer; each thread reuses its own, as call_function never re-enters.
+            static thread_local std::vector<double> values;
+            const double* data = values.data();
+            size_t count = 0;
+
+            if (argc == 1 && args[0].kind == Operand::Ref && args[0].ref->is_number_array()) {
+                const JSONNumberArray& numbers = args[0].ref->as_number_array();
+                data = numbers.data();
+                count = numbers.size();
             } else {
-                throw EvalError("max requires numeric values");
-            }
-        }
-        if (max_value == -std::numeric_limits<double>::infinity()) throw EvalError("max requires at least one numeric value");
-        return JSONValue(max_value);
-    } else if (func_name == "size") {
-        if (args.size() != 1) throw EvalError("size requires exactly one argument");
-        JSONValue val = evaluate_expression(args[0]);
-        if (val.is_string()) {
-            return JSONValue(static_cast<double>(val.as_string().size()));
-        } else if (val.is_array()) {
-            return JSONValue(static_cast<double>(val.as_array().size()));
-        } else if (val.is_object()) {
-            return JSONValue(static_cast<double>(val.as_object().size()));
-        } else {
-            throw EvalError("size requires an object, array, or string");
-        }
-    } else if (func_name == "sum") {
-        double sum = 0.0;
-        
-        // Launch async tasks to evaluate each argument concurrently
-        std::vector<std::future<JSONValue>> futures;
-        for (const auto& arg : args) {
-            futures.push_back(std::async(&Evaluator::evaluate_expression, this, arg));
-        }
-
-        // Collect results and calculate the sum
-        for (auto& future : futures) {
-            JSONValue val = future.get();
-            if (val.is_array()) {
-                for (const auto& item : val.as_array()) {
-                    if (!item.is_number()) throw EvalError("sum requires numeric values");
-                    sum += item.as_number();
+                values.clear();
+                // Arrays contribute each of their elements
+                for (size_t i = 0; i < argc; ++i) {
+                    const Operand& val = args[i];
+                    if (val.kind == Operand::Ref && val.ref->is_number_array()) {
+                        const JSONNumberArray& numbers = val.ref->as_number_array();
+                        values.insert(values.end(), numbers.begin(), numbers.end());
+                    } else if (val.kind == Operand::Ref && val.ref->is_array()) {
+                        const JSONArray& items = val.ref->as_array();
+                        values.reserve(values.size() + items.size());
+                        for (const auto& item : items) {
+                            if (!item.is_number()) throw EvalError(std::string(name) + " requires numeric values");
+                            values.push_back(item.as_number());
+                        }
+                    } else if (val.kind == Operand::Number) {
+                        values.push_back(val.number);
+                    } else {
+                        throw EvalError(std::string(name) + " requires numeric values");
+                    }
                 }
-            } else if (val.is_number()) {
-                sum += val.as_number();
-            } else {
-                throw EvalError("sum requires numeric values");
+                data = values.data();
+                count = values.size();
             }
-        }
-        return JSONValue(sum);
-    } else if (func_name == "avg") {
-        double sum = 0.0;
-        int count = 0;
 
-        std::vector<std::future<JSONValue>> futures;
-        for (const auto& arg : args) {
-            futures.push_back(std::async(&Evaluator::evaluate_expression, this, arg));
+            if (function == Function::Min) {
+                double min_value = reduce_min(data, count);
+                if (min_value == std::numeric_limits<double>::infinity()) throw EvalError("min requires at least one numeric value");
+                return Operand::of_number(min_value);
+            }
+            if (function == Function::Max) {
+                double max_value = reduce_max(data, count);
+                if (max_value == -std::numeric_limits<double>::infinity()) throw EvalError("max requires at least one numeric value");
+                return Operand::of_number(max_value);
+            }
+            double sum = reduce_sum(data, count);
+            if (function == Function::Sum) return Operand::of_number(sum);
+            if (count == 0) throw EvalError("avg requires at least one numeric value");
+            return Operand::of_number(sum / static_cast<double>(count));
         }
-
-        for (auto& future : futures) {
-            JSONValue val = future.get();
-            if (val.is_array()) {
-                for (const auto& item : val.as_array()) {
-                    if (!item.is_number()) throw EvalError("avg requires numeric values");
-                    sum += item.as_number();
-                    count++;
+        case Function::Size:
+        case Function::Count: {
+            const Operand& val = args[0];
+            if (val.kind == Operand::Ref) {
+                if (val.ref->is_string()) return Operand::of_number(static_cast<double>(val.ref->as_string().size()));
+                if (val.ref->is_array()) return Operand::of_number(static_cast<double>(val.ref->array_size()));
+                if (val.ref->is_object() && function == Function::Size) {
+                    return Operand::of_number(static_cast<double>(val.ref->as_object().size()));
                 }
-            } else if (val.is_number()) {
-                sum += val.as_number();
-                count++;
-            } else {
-                throw EvalError("avg requires numeric values");
             }
-        }
-
-        if (count == 0) throw EvalError("avg requires at least one numeric value");
-        return JSONValue(sum / count);
-    } else if (func_name == "count") {
-        if (args.size() != 1) throw EvalError("count requires exactly one argument");
-        JSONValue val = evaluate_expression(args[0]);
-        if (val.is_array()) {
-            return JSONValue(static_cast<double>(val.as_array().size()));
-        } else if (val.is_string()) {
-            return JSONValue(static_cast<double>(val.as_string().size()));
-        } else {
+            if (function == Function::Size) throw EvalError("size requires an object, array, or string");
             throw EvalError("count requires an array or string");
         }
-    } else if (func_name == "abs") {
-        if (args.size() != 1) throw EvalError("abs requires exactly one argument");
-        JSONValue val = evaluate_expression(args[0]);
-        if (!val.is_number()) throw EvalError("abs requires a numeric value");
-        return JSONValue(std::abs(val.as_number()));
-    } else if (func_name == "round") {
-        if (args.size() != 1) throw EvalError("round requires exactly one argument");
-        JSONValue val = evaluate_expression(args[0]);
-        if (!val.is_number()) throw EvalError("round requires a numeric value");
-        return JSONValue(std::round(val.as_number()));
-    } else {
-        throw EvalError("Unknown function: " + func_name);
+        case Function::Abs:
+        case Function::Round: {
+            const Operand& val = args[0];
+            if (val.kind != Operand::Number) throw EvalError(std::string(name) + " requires a numeric value");
+            return Operand::of_number(function == Function::Abs ? std::abs(val.number) : std::round(val.number));
+        }
     }
+    throw EvalError("Unknown function: " + std::string(name));
 }
 
-JSONValue Evaluator::evaluate_json_path(const std::string& path) {
-    JSONValue current = root;
-    size_t pos = 0;
+Operand Evaluator::resolve_path(const JSONPath& path) const {
+    const JSONValue* current = &document->root();
 
-    // Read the initial key segment (e.g., "a" in "a.b[2]")
-    while (pos < path.size() && (std::isalnum(path[pos]) || path[pos] == '_')) ++pos;
-    std::string key = path.substr(0, pos);
-    current = get_value(current, key);
-
-    while (pos < path.size()) {
-        if (path[pos] == '.') {
-            ++pos;
-            size_t start = pos;
-            while (pos < path.size() && (std::isalnum(path[pos]) || path[pos] == '_')) ++pos;
-            key = path.substr(start, pos - start);
-
-            if (!current.is_object()) {
-                throw EvalError("Invalid key access on non-object type: " + key);
-            }
-            current = get_value(current, key);
-        } else if (path[pos] == '[') {
-            ++pos;
-            size_t start = pos;
-            while (pos < path.size() && path[pos] != ']') ++pos;
-            if (pos >= path.size() || path[pos] != ']') {
-                throw EvalError("Expected ']' for array index access.");
-            }
-
-            std::string index_str = path.substr(start, pos - start);
-            ++pos; // Move past ']'
-
-            if (!index_str.empty() && std::all_of(index_str.begin(), index_str.end(), ::isdigit)) {
-                size_t index = std::stoul(index_str);
-                if (!current.is_array()) {
-                    throw EvalError("Invalid array index access on non-array type.");
-                }
-                const JSONArray& arr = current.as_array();
-                if (index >= arr.size()) {
-                    throw EvalError("Array index out of bounds: " + index_str);
-                }
-                current = arr[index];
-            } else {
-                throw EvalError("Invalid array index: " + index_str + " (must be an integer).");
-            }
-        } else {
-            throw EvalError("Unexpected syntax or character in path: " + path.substr(pos));
+    for (size_t i = 0; i < path.segments.size(); ++i) {
+        const PathSegment& segment = path.segments[i];
+        if (!segment.is_index) {
+            current = &get_value(*current, segment);
+            continue;
+        }
+        if (!current->is_array()) {
+            throw EvalError("Invalid array index access on non-array type.");
+        }
+        if (segment.index >= current->array_size()) {
+            throw EvalError("Array index out of bounds: " + std::to_string(segment.index));
         }
+        if (current->is_number_array()) {
+            // A number has nothing further to walk into
+            double number = current->as_number_array()[segment.index];
+            if (i + 1 == path.segments.size()) return Operand::of_number(number);
+            const PathSegment& next = path.segments[i + 1];
+            if (next.is_index) throw EvalError("Invalid array index access on non-array type.");
+            throw EvalError("Invalid key access on non-object type: " + next.key);
+        }
+        current = &current->as_array()[segment.index];
     }
 
-    return current;
+    return Operand::of_value(*current);
 }
 
-
-size_t Evaluator::find_matching_bracket(const std::string& s, size_t pos) {
-    int depth = 1;
-    for (size_t i = pos + 1; i < s.size(); ++i) {
-        if (s[i] == '(') depth++;
-        else if (s[i] == ')') depth--;
-        if (depth == 0) return i;
+const JSONValue& Evaluator::get_value(const JSONValue& current, const PathSegment& segment) const {
+    if (!current.is_object()) {
+        throw EvalError("Invalid key access on non-object type: " + segment.key);
     }
-    throw EvalError("Mismatched parentheses");
-}
-
-JSONValue Evaluator::get_value(const JSONValue& current, const std::string& key) {
-    if (current.is_object()) {
-        const JSONObject& obj = current.as_object();
-        auto it = obj.find(key);
-        if (it != obj.end()) return it->second;
-        else throw EvalError("Key not found: " + key);
-    } else if (current.is_array()) {
-        try {
-            size_t index = std::stoul(key);
-            const JSONArray& arr = current.as_array();
-            if (index >= arr.size()) throw EvalError("Array index out of bounds: " + key);
-            return arr[index]; // Return directly without altering
-        } catch (const std::invalid_argument&) {
-            throw EvalError("Invalid array index: " + key);
-        } catch (const std::out_of_range&) {
-            throw EvalError("Array index out of range: " + key);
+    // Objects of the shape seen last keep the key in the same slot
+    const JSONObject& obj = current.as_object();
+    const JSONShape& shape = obj.shape();
+    uint64_t cached = segment.cache.entry.load(std::memory_order_relaxed);
+    if (cached >> 16 == shape.id) return obj.value_at(cached & 0xFFFF); // Borrowed, never copied
+
+    // Keys are interned per table, so once the name is found in the shape's table
+    // the shape only compares pointers. A name missing there is in no object.
+    const JSONKey* key = shape.table ? shape.table->find(segment.key, segment.key_hash) : nullptr;
+    if (key) {
+        size_t slot = shape.slot_of(key);
+        if (slot != shape.size) {
+            if (slot <= 0xFFFF) segment.cache.entry.store(shape.id << 16 | slot, std::memory_order_relaxed);
+            return obj.value_at(slot);
         }
-    } else {
-        throw EvalError("Current value is not an object or array");
     }
+    throw EvalError("Key not found: " + segment.key);
 }
-
@@ -2,33 +2,83 @@
 #define EVALUATOR_H
 
 #include "json.h"
+#include "expression.h"
 #include <string>
 #include <exception>
 #include <map>
+#include <functional>
 
-class EvalError : public std::exception {
-    std::string message;
-public:
-    EvalError(const std::string& msg) : message(msg) {}
-    const char* what() const noexcept override { return message.c_str(); }
+class ThreadPool;
+
+// Intermediate result of evaluating an expression node. Scalars are held
+// inline; strings and containers read from the document are borrowed by
+// pointer, so only the final result is ever copied.
+struct Operand {
+    enum Kind { Null, Bool, Number, Ref };
+
+    Kind kind = Null;
+    bool boolean = false;
+    double number = 0;
+    const JSONValue* ref = nullptr; // Also set for integers read straight from the document
+
+    static Operand of_bool(bool b) { Operand o; o.kind = Bool; o.boolean = b; return o; }
+    static Operand of_number(double d) { Operand o; o.kind = Number; o.number = d; return o; }
+    static Operand of_value(const JSONValue& value);
+
+    // Packed numeric arrays, at any depth, are handed out in the generic JSONArray form
+    JSONValue materialize() const;
 };
 
 class Evaluator {
-    JSONValue root;
+    // Shared with every other evaluator built from the same document; never mutated
+    JSONDocumentPtr document;
+    ThreadPool* pool = nullptr; // nullptr means ThreadPool::shared()
+    size_t parallel_threshold = AGGREGATE_COST;
+
+    // Runs fn(i) for every argument; those costing at least parallel_threshold go to the pool
+    void dispatch_arguments(const std::vector<size_t>& costs, const std::function<void(size_t)>& fn) const;
 
-    JSONValue evaluate_expression(const std::string& expr);
-    JSONValue evaluate_json_path(const std::string& path);
-    JSONValue evaluate_function(const std::string& func_name, const std::vector<std::string>& args);
-    std::vector<std::string> parse_arguments(const std::string& args_str);
+    // Bytecode VM (vm.cpp)
+    Operand execute(const Program& program) const;
+    // Native tier; false means the VM has to produce the result
+    bool run_jit(const NumericJIT& jit, double& result) const;
+
+    // Tree-walking interpreter over the AST
+    Operand evaluate_node(const ExprNode& node) const;
+    Operand evaluate_binary(const ExprNode& node) const;
+    Operand evaluate_function(const ExprNode& node) const;
+
+    // Semantics shared by the VM and the tree walker
+    static bool truthy(const Operand& operand);
+    static Operand apply_arithmetic(Operator op, const Operand& left, const Operand& right);
+    static Operand call_function(Function function, const Operand* args, size_t argc);
+
+    // Walks the document by reference; nothing is copied along the way.
+    // Elements of packed numeric arrays come back as inline numbers.
+    Operand resolve_path(const JSONPath& path) const;
 
     // Helper functions
-    size_t find_matching_bracket(const std::string& s, size_t pos);
-    JSONValue get_value(const JSONValue& current, const std::string& key);
+    const JSONValue& get_value(const JSONValue& current, const PathSegment& segment) const;
 
 public:
-    Evaluator(const JSONValue& json_root) : root(json_root) {}
-    JSONValue evaluate(const std::string& expr);
+    // Copies json_root into a private document; pass a JSONDocumentPtr to share one instead
+    Evaluator(const JSONValue& json_root) : document(std::make_shared<const JSONDocument>(json_root)) {}
+    Evaluator(JSONDocumentPtr doc);
+
+    // Compiles expr and evaluates it once; compile it yourself to evaluate it repeatedly
+    JSONValue evaluate(const std::string& expr) const;
+    JSONValue evaluate(const CompiledExpression& expr) const;
+    // Reference tree-walking evaluation of the same expression, bypassing the VM
+    JSONValue evaluate_tree(const CompiledExpression& expr) const;
+    const JSONDocumentPtr& get_document() const { return document; }
+    // Points the evaluator at another document, keeping its other settings.
+    // Compiled expressions stay valid across documents.
+    void set_document(JSONDocumentPtr doc);
+
+    // Function arguments whose estimated cost reaches the threshold run on the pool;
+    // cheaper ones are evaluated inline. SIZE_MAX disables parallel evaluation.
+    void set_thread_pool(ThreadPool* thread_pool) { pool = thread_pool; }
+    void set_parallel_threshold(size_t cost) { parallel_threshold = cost; }
 };
 
 #endif
-
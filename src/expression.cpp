@@ -0,0 +1,408 @@
+#include "expression.h"
+#include "jit.h"
+#include "key_table.h"
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+struct Token {
+    enum Kind { Number, Path, LParen, RParen, Comma, Op, End };
+
+    Kind kind = End;
+    size_t pos = 0;
+    size_t length = 0;
+    double number = 0;
+    Operator op = Operator::Add;
+    JSONPath path;
+};
+
+// Binding power of each binary operator; higher binds tighter
+static int precedence(Operator op) {
+    switch (op) {
+        case Operator::Or: return 1;
+        case Operator::And: return 2;
+        case Operator::Add: case Operator::Sub: return 3;
+        case Operator::Mul: case Operator::Div: case Operator::Mod: return 4;
+        case Operator::Pow: return 6;
+        default: return 0;
+    }
+}
+
+// Unary minus and '!' bind looser than '**' so "-2 ** 2" is -(2 ** 2)
+static const int UNARY_PRECEDENCE = 5;
+
+static bool is_key_char(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+const char* function_name(Function function) {
+    switch (function) {
+        case Function::Min: return "min";
+        case Function::Max: return "max";
+        case Function::Sum: return "sum";
+        case Function::Avg: return "avg";
+        case Function::Size: return "size";
+        case Function::Count: return "count";
+        case Function::Abs: return "abs";
+        case Function::Round: return "round";
+    }
+    return "";
+}
+
+double truncated_mod(double left, double right) {
+    return std::fmod(std::trunc(left), std::trunc(right)) + 0.0; // + 0.0 turns -0 into 0
+}
+
+static Function lookup_function(const std::string& name) {
+    static const Function functions[] = {
+        Function::Min, Function::Max, Function::Sum, Function::Avg,
+        Function::Size, Function::Count, Function::Abs, Function::Round,
+    };
+    for (Function f : functions) {
+        if (name == function_name(f)) return f;
+    }
+    throw EvalError("Unknown function: " + name);
+}
+
+// Tokenizer and precedence-climbing parser. Used only at compile time.
+class ExpressionParser {
+    const std::string& text;
+    size_t index;
+    Token current;
+
+    void skip_whitespace();
+    Token next_token();
+    void scan_path(Token& token);
+    void advance() { current = next_token(); }
+    std::string token_text(const Token& token) const;
+    void expect(Token::Kind kind, const std::string& message);
+
+    std::unique_ptr<ExprNode> parse_prefix();
+    std::unique_ptr<ExprNode> parse_call(const std::string& name);
+
+public:
+    ExpressionParser(const std::string& text) : text(text), index(0) { advance(); }
+    std::unique_ptr<ExprNode> parse_expression(int min_precedence);
+    void expect_end();
+};
+
+void ExpressionParser::skip_whitespace() {
+    while (index < text.size() && std::isspace(static_cast<unsigned char>(text[index]))) ++index;
+}
+
+std::string ExpressionParser::token_text(const Token& token) const {
+    if (token.kind == Token::End) return "end of expression";
+    return "'" + text.substr(token.pos, token.length) + "'";
+}
+
+void ExpressionParser::scan_path(Token& token) {
+    token.kind = Token::Path;
+    size_t start = index;
+    while (index < text.size() && is_key_char(text[index])) ++index;
+    std::string key = text.substr(start, index - start);
+    token.path.segments.push_back({false, key, 0, KeyTable::hash(key)});
+
+    while (index < text.size()) {
+        if (text[index] == '.') {
+            ++index;
+            start = index;
+            while (index < text.size() && is_key_char(text[index])) ++index;
+            if (index == start) throw EvalError("Unexpected syntax or character in path: " + text.substr(start - 1));
+            key = text.substr(start, index - start);
+            token.path.segments.push_back({false, key, 0, KeyTable::hash(key)});
+        } else if (text[index] == '[') {
+            ++index;
+            start = index;
+            while (index < text.size() && text[index] != ']') ++index;
+            if (index >= text.size()) throw EvalError("Expected ']' for array index access.");
+            std::string index_str = text.substr(start, index - start);
+            ++index; // Move past ']'
+
+            bool digits = !index_str.empty();
+            for (char c : index_str) digits = digits && std::isdigit(static_cast<unsigned char>(c));
+            if (!digits) throw EvalError("Invalid array index: " + index_str + " (must be an integer).");
+            if (index_str.size() > 18) throw EvalError("Array index out of range: " + index_str);
+            token.path.segments.push_back({true, "", std::stoul(index_str)});
+        } else {
+            break;
+        }
+    }
+}
+
+Token ExpressionParser::next_token() {
+    skip_whitespace();
+    Token token;
+    token.pos = index;
+    if (index >= text.size()) return token;
+
+    char c = text[index];
+    if (std::isdigit(static_cast<unsigned char>(c))) {
+        token.kind = Token::Number;
+        while (index < text.size() && std::isdigit(static_cast<unsigned char>(text[index]))) ++index;
+        if (index < text.size() && text[index] == '.') {
+            ++index;
+            while (index < text.size() && std::isdigit(static_cast<unsigned char>(text[index]))) ++index;
+        }
+        if (index < text.size() && (text[index] == 'e' || text[index] == 'E')) {
+            ++index;
+            if (index < text.size() && (text[index] == '+' || text[index] == '-')) ++index;
+            if (index >= text.size() || !std::isdigit(static_cast<unsigned char>(text[index]))) {
+                throw EvalError("Invalid number literal: " + text.substr(token.pos, index - token.pos));
+            }
+            while (index < text.size() && std::isdigit(static_cast<unsigned char>(text[index]))) ++index;
+        }
+        token.number = std::strtod(text.substr(token.pos, index - token.pos).c_str(), nullptr);
+    } else if (is_key_char(c)) {
+        scan_path(token);
+    } else if (c == '(') {
+        token.kind = Token::LParen;
+        ++index;
+    } else if (c == ')') {
+        token.kind = Token::RParen;
+        ++index;
+    } else if (c == ',') {
+        token.kind = Token::Comma;
+        ++index;
+    } else {
+        token.kind = Token::Op;
+        std::string two = text.substr(index, 2);
+        if (two == "**") token.op = Operator::Pow;
+        else if (two == "&&") token.op = Operator::And;
+        else if (two == "||") token.op = Operator::Or;
+        else if (c == '+') token.op = Operator::Add;
+        else if (c == '-') token.op = Operator::Sub;
+        else if (c == '*') token.op = Operator::Mul;
+        else if (c == '/') token.op = Operator::Div;
+        else if (c == '%') token.op = Operator::Mod;
+        else if (c == '!') token.op = Operator::Not;
+        else throw EvalError("Unexpected character '" + std::string(1, c) + "' at position " + std::to_string(index));
+        index += (token.op == Operator::Pow || token.op == Operator::And || token.op == Operator::Or) ? 2 : 1;
+    }
+    token.length = index - token.pos;
+    return token;
+}
+
+void ExpressionParser::expect(Token::Kind kind, const std::string& message) {
+    if (current.kind != kind) throw EvalError(message + ", found " + token_text(current));
+    advance();
+}
+
+void ExpressionParser::expect_end() {
+    if (current.kind != Token::End) {
+        throw EvalError("Unexpected " + token_text(current) + " at position " + std::to_string(current.pos));
+    }
+}
+
+std::unique_ptr<ExprNode> ExpressionParser::parse_expression(int min_precedence) {
+    std::unique_ptr<ExprNode> left = parse_prefix();
+
+    while (current.kind == Token::Op && precedence(current.op) >= min_precedence) {
+        Operator op = current.op;
+        int prec = precedence(op);
+        advance();
+        // '**' is right-associative, everything else groups to the left
+        std::unique_ptr<ExprNode> right = parse_expression(op == Operator::Pow ? prec : prec + 1);
+
+        auto node = std::make_unique<ExprNode>(ExprNode::Binary);
+        node->op = op;
+        node->children.push_back(std::move(left));
+        node->children.push_back(std::move(right));
+        left = std::move(node);
+    }
+    return left;
+}
+
+std::unique_ptr<ExprNode> ExpressionParser::parse_prefix() {
+    Token token = current;
+
+    if (token.kind == Token::Number) {
+        advance();
+        auto node = std::make_unique<ExprNode>(ExprNode::Number);
+        node->number = token.number;
+        return node;
+    }
+
+    if (token.kind == Token::Path) {
+        advance();
+        if (token.path.segments.size() == 1) {
+            const std::string& name = token.path.segments[0].key;
+            if (current.kind == Token::LParen) return parse_call(name);
+            if (name == "true" || name == "false") {
+                auto node = std::make_unique<ExprNode>(ExprNode::Bool);
+                node->boolean = name == "true";
+                return node;
+            }
+            if (name == "null") return std::make_unique<ExprNode>(ExprNode::Null);
+        }
+        auto node = std::make_unique<ExprNode>(ExprNode::Path);
+        node->path = std::move(token.path);
+        return node;
+    }
+
+    if (token.kind == Token::LParen) {
+        advance();
+        std::unique_ptr<ExprNode> inner = parse_expression(1);
+        expect(Token::RParen, "Mismatched parentheses");
+        return inner;
+    }
+
+    if (token.kind == Token::Op && (token.op == Operator::Sub || token.op == Operator::Not)) {
+        advance();
+        auto node = std::make_unique<ExprNode>(ExprNode::Unary);
+        node->op = token.op == Operator::Sub ? Operator::Neg : Operator::Not;
+        node->children.push_back(parse_expression(UNARY_PRECEDENCE));
+        return node;
+    }
+
+    throw EvalError("Unexpected " + token_text(token) + " at position " + std::to_string(token.pos));
+}
+
+std::unique_ptr<ExprNode> ExpressionParser::parse_call(const std::string& name) {
+    auto node = std::make_unique<ExprNode>(ExprNode::Call);
+    node->function = lookup_function(name);
+    advance(); // skip '('
+
+    if (current.kind != Token::RParen) {
+        while (true) {
+            node->children.push_back(parse_expression(1));
+            if (current.kind != Token::Comma) break;
+            advance();
+        }
+    }
+    expect(Token::RParen, "Mismatched parentheses");
+
+    switch (node->function) {
+        case Function::Size: case Function::Count: case Function::Abs: case Function::Round:
+            if (node->children.size() != 1) throw EvalError(name + " requires exactly one argument");
+            break;
+        default:
+            if (node->children.empty()) throw EvalError(name + " requires at least one argument");
+    }
+    return node;
+}
+
+static OpCode arithmetic_opcode(Operator op) {
+    switch (op) {
+        case Operator::Add: return OpCode::Add;
+        case Operator::Sub: return OpCode::Sub;
+        case Operator::Mul: return OpCode::Mul;
+        case Operator::Div: return OpCode::Div;
+        case Operator::Mod: return OpCode::Mod;
+        default: return OpCode::Pow;
+    }
+}
+
+// Emits code for one AST node, tracking the stack depth it needs
+static void lower_node(const ExprNode& node, Program& program, size_t& depth) {
+    auto emit = [&](OpCode op, uint32_t operand = 0, uint8_t aux = 0) {
+        program.code.push_back({op, aux, operand});
+    };
+    auto push = [&] { program.max_stack = std::max(program.max_stack, ++depth); };
+
+    switch (node.kind) {
+        case ExprNode::Number:
+            emit(OpCode::PushNumber, static_cast<uint32_t>(program.constants.size()));
+            program.constants.push_back(node.number);
+            push();
+            break;
+        case ExprNode::Bool:
+            emit(OpCode::PushBool, node.boolean ? 1 : 0);
+            push();
+            break;
+        case ExprNode::Null:
+            emit(OpCode::PushNull);
+            push();
+            break;
+        case ExprNode::Path:
+            emit(OpCode::LoadPath, static_cast<uint32_t>(program.paths.size()));
+            program.paths.push_back(node.path);
+            push();
+            break;
+        case ExprNode::Unary:
+            lower_node(*node.children[0], program, depth);
+            emit(node.op == Operator::Neg ? OpCode::Neg : OpCode::Not);
+            break;
+        case ExprNode::Binary: {
+            lower_node(*node.children[0], program, depth);
+            if (node.op == Operator::And || node.op == Operator::Or) {
+                size_t jump = program.code.size();
+                emit(node.op == Operator::And ? OpCode::AndJump : OpCode::OrJump);
+                --depth;
+                lower_node(*node.children[1], program, depth);
+                emit(OpCode::ToBool);
+                program.code[jump].operand = static_cast<uint32_t>(program.code.size());
+                break;
+            }
+            lower_node(*node.children[1], program, depth);
+            emit(arithmetic_opcode(node.op));
+            --depth;
+            break;
+        }
+        case ExprNode::Call: {
+            bool aggregate = node.function == Function::Min || node.function == Function::Max ||
+                             node.function == Function::Sum || node.function == Function::Avg;
+            size_t heaviest = 0;
+            for (const auto& arg : node.children) heaviest = std::max(heaviest, arg->cost);
+
+            // Arguments that may be worth a thread each get their own program
+            if (aggregate && node.children.size() > 1 && heaviest >= AGGREGATE_COST) {
+                std::vector<Program> args;
+                for (const auto& arg : node.children) args.push_back(Program::lower(*arg));
+                emit(OpCode::CallParallel, static_cast<uint32_t>(program.parallel_args.size()), static_cast<uint8_t>(node.function));
+                program.parallel_args.push_back(std::move(args));
+                push();
+                break;
+            }
+
+            for (const auto& arg : node.children) lower_node(*arg, program, depth);
+            emit(OpCode::Call, static_cast<uint32_t>(node.children.size()), static_cast<uint8_t>(node.function));
+            depth -= node.children.size() - 1;
+            break;
+        }
+    }
+}
+
+Program Program::lower(const ExprNode& root) {
+    Program program;
+    program.cost = root.cost;
+    size_t depth = 0;
+    lower_node(root, program, depth);
+    program.code.push_back({OpCode::Return, 0, 0});
+    return program;
+}
+
+static size_t annotate_cost(ExprNode& node) {
+    size_t cost = node.kind == ExprNode::Path ? 1 + node.path.segments.size() : 1;
+    bool scans = node.kind == ExprNode::Call &&
+                 (node.function == Function::Min || node.function == Function::Max ||
+                  node.function == Function::Sum || node.function == Function::Avg);
+    for (auto& child : node.children) {
+        cost += annotate_cost(*child);
+        // A path argument to an aggregate may be an array of any length
+        if (scans && child->kind == ExprNode::Path) cost += AGGREGATE_COST;
+    }
+    node.cost = cost;
+    return cost;
+}
+
+CompiledExpression::CompiledExpression() = default;
+CompiledExpression::CompiledExpression(CompiledExpression&&) noexcept = default;
+CompiledExpression& CompiledExpression::operator=(CompiledExpression&&) noexcept = default;
+CompiledExpression::~CompiledExpression() = default;
+
+bool CompiledExpression::enable_jit() {
+    if (!jit) jit = NumericJIT::compile(*root);
+    return jit != nullptr;
+}
+
+CompiledExpression CompiledExpression::compile(const std::string& expr) {
+    ExpressionParser parser(expr);
+    CompiledExpression compiled;
+    compiled.source = expr;
+    compiled.root = parser.parse_expression(1);
+    parser.expect_end();
+    annotate_cost(*compiled.root);
+    compiled.program = Program::lower(*compiled.root);
+    return compiled;
+}
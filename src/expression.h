@@ -0,0 +1,134 @@
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+#include <exception>
+#include <cstdint>
+
+class EvalError : public std::exception {
+    std::string message;
+public:
+    EvalError(const std::string& msg) : message(msg) {}
+    const char* what() const noexcept override { return message.c_str(); }
+};
+
+// Shape a key segment last resolved against, and its slot there; copies start empty
+struct ShapeCache {
+    mutable std::atomic<uint64_t> entry{0}; // shape id << 16 | slot, or 0
+
+    ShapeCache() = default;
+    ShapeCache(const ShapeCache&) {}
+    ShapeCache& operator=(const ShapeCache&) {
+        entry.store(0, std::memory_order_relaxed);
+        return *this;
+    }
+};
+
+// One step of a JSON path: ".key" or "[index]"
+struct PathSegment {
+    bool is_index;
+    std::string key;
+    size_t index;
+    size_t key_hash = 0; // KeyTable::hash(key), computed once when the path is parsed
+    ShapeCache cache{};
+};
+
+struct JSONPath {
+    std::vector<PathSegment> segments;
+};
+
+enum class Function { Min, Max, Sum, Avg, Size, Count, Abs, Round };
+
+enum class Operator { Add, Sub, Mul, Div, Mod, Pow, And, Or, Neg, Not };
+
+// Estimated cost of an aggregate scanning an array of unknown length. Also the
+// default cost above which an argument is worth evaluating on another thread.
+const size_t AGGREGATE_COST = 1000;
+
+struct ExprNode {
+    enum Kind { Number, Bool, Null, Path, Unary, Binary, Call };
+
+    Kind kind;
+    double number = 0;
+    bool boolean = false;
+    Operator op = Operator::Add;
+    Function function = Function::Min;
+    JSONPath path;
+    std::vector<std::unique_ptr<ExprNode>> children;
+    size_t cost = 1; // Static estimate of evaluation work, filled in by compile()
+
+    explicit ExprNode(Kind k) : kind(k) {}
+};
+
+enum class OpCode : uint8_t {
+    PushNumber,  // operand: index into constants
+    PushBool,    // operand: 0 or 1
+    PushNull,
+    LoadPath,    // operand: index into paths
+    Neg, Not,
+    Add, Sub, Mul, Div, Mod, Pow,
+    AndJump,     // operand: target; if the top is falsy replace it with false and jump, else pop it
+    OrJump,      // operand: target; if the top is truthy replace it with true and jump, else pop it
+    ToBool,
+    Call,        // aux: Function, operand: argument count
+    CallParallel, // aux: Function, operand: index into parallel_args
+    Return
+};
+
+struct Instruction {
+    OpCode op;
+    uint8_t aux;
+    uint32_t operand;
+};
+
+// Linear stack-machine form of an expression, executed by Evaluator's VM
+struct Program {
+    std::vector<Instruction> code;
+    std::vector<double> constants;
+    std::vector<JSONPath> paths;
+    // Arguments of aggregate calls expensive enough to run in parallel, one program each
+    std::vector<std::vector<Program>> parallel_args;
+    size_t max_stack = 0;
+    size_t cost = 0;
+
+    static Program lower(const ExprNode& root);
+};
+
+class NumericJIT;
+
+// An expression parsed once into an AST and lowered to bytecode. Evaluating it
+// against a document does no tokenizing, substring copies or name lookups.
+class CompiledExpression {
+    std::string source;
+    std::unique_ptr<ExprNode> root;
+    Program program;
+    std::unique_ptr<NumericJIT> jit;
+
+public:
+    CompiledExpression();
+    CompiledExpression(CompiledExpression&&) noexcept;
+    CompiledExpression& operator=(CompiledExpression&&) noexcept;
+    ~CompiledExpression();
+
+    static CompiledExpression compile(const std::string& expr);
+
+    // Generates native code when the expression is purely numeric; returns whether it did.
+    // Evaluation falls back to the VM whenever the native code cannot produce the result.
+    bool enable_jit();
+
+    const ExprNode& get_root() const { return *root; }
+    const Program& get_program() const { return program; }
+    const NumericJIT* get_jit() const { return jit.get(); }
+    const std::string& get_source() const { return source; }
+};
+
+const char* function_name(Function function);
+
+// '%' on the truncated operands, as C's integer '%' but for any magnitude; the sign
+// follows the left operand. Callers reject a right operand that truncates to 0.
+double truncated_mod(double left, double right);
+
+#endif
@@ -0,0 +1,266 @@
+#include "jit.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define JSON_EVAL_JIT 1
+#include <sys/mman.h>
+#endif
+
+// Helpers the generated code calls for operations without a single instruction
+static double jit_pow(double l, double r) { return std::pow(l, r); }
+static double jit_round(double v) { return std::round(v); }
+static double jit_mod(double l, double r) { return truncated_mod(l, r); } // Same as the interpreter
+
+// Whether every node can be compiled to straight-line floating point code
+static bool is_numeric(const ExprNode& node) {
+    switch (node.kind) {
+        case ExprNode::Number:
+        case ExprNode::Path:
+            return true;
+        case ExprNode::Unary:
+            return node.op == Operator::Neg && is_numeric(*node.children[0]);
+        case ExprNode::Binary:
+            if (node.op == Operator::And || node.op == Operator::Or) return false;
+            return is_numeric(*node.children[0]) && is_numeric(*node.children[1]);
+        case ExprNode::Call:
+            if (node.function != Function::Abs && node.function != Function::Round &&
+                node.function != Function::Min && node.function != Function::Max) {
+                return false;
+            }
+            for (const auto& arg : node.children) {
+                if (!is_numeric(*arg)) return false;
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool same_path(const JSONPath& a, const JSONPath& b) {
+    if (a.segments.size() != b.segments.size()) return false;
+    for (size_t i = 0; i < a.segments.size(); ++i) {
+        const PathSegment& x = a.segments[i];
+        const PathSegment& y = b.segments[i];
+        if (x.is_index != y.is_index || x.key != y.key || x.index != y.index) return false;
+    }
+    return true;
+}
+
+// Emits System V x86-64 code for `double fn(const double* slots, int* status)`.
+// Every node leaves its value in xmm0; left operands are spilled to the stack.
+class CodeGenerator {
+    std::vector<uint8_t>& out;
+    std::vector<JSONPath>& slots;
+    std::vector<size_t> error_jumps;
+    size_t depth = 0; // 8-byte temporaries currently pushed
+
+    void emit(std::initializer_list<uint8_t> bytes) { out.insert(out.end(), bytes); }
+    void emit_u32(uint32_t v) { for (int i = 0; i < 4; ++i) out.push_back(static_cast<uint8_t>(v >> (8 * i))); }
+    void emit_u64(uint64_t v) { for (int i = 0; i < 8; ++i) out.push_back(static_cast<uint8_t>(v >> (8 * i))); }
+
+    void load_constant(double value, bool into_xmm1) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof bits);
+        emit({0x48, 0xB8}); emit_u64(bits);                           // mov rax, imm64
+        emit({0x66, 0x48, 0x0F, 0x6E, uint8_t(into_xmm1 ? 0xC8 : 0xC0)}); // movq xmm0/xmm1, rax
+    }
+    void push_xmm0() {
+        emit({0x48, 0x83, 0xEC, 0x08});       // sub rsp, 8
+        emit({0xF2, 0x0F, 0x11, 0x04, 0x24}); // movsd [rsp], xmm0
+        ++depth;
+    }
+    void pop_xmm0() {
+        emit({0xF2, 0x0F, 0x10, 0x04, 0x24}); // movsd xmm0, [rsp]
+        emit({0x48, 0x83, 0xC4, 0x08});       // add rsp, 8
+        --depth;
+    }
+    void jump_to_error_if_equal() {
+        emit({0x0F, 0x84});                   // je rel32 (patched later)
+        error_jumps.push_back(out.size());
+        emit_u32(0);
+    }
+    void call(const void* helper) {
+        bool pad = depth % 2 != 0;            // keep rsp 16-byte aligned at the call
+        if (pad) emit({0x48, 0x83, 0xEC, 0x08});
+        emit({0x48, 0xB8}); emit_u64(reinterpret_cast<uint64_t>(helper)); // mov rax, helper
+        emit({0xFF, 0xD0});                   // call rax
+        if (pad) emit({0x48, 0x83, 0xC4, 0x08});
+    }
+
+    size_t slot_for(const JSONPath& path) {
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (same_path(slots[i], path)) return i;
+        }
+        slots.push_back(path);
+        return slots.size() - 1;
+    }
+
+    void generate_binary(const ExprNode& node) {
+        generate(*node.children[0]);
+        push_xmm0();
+        generate(*node.children[1]);
+        emit({0x66, 0x0F, 0x28, 0xC8});               // movapd xmm1, xmm0
+        pop_xmm0();
+        switch (node.op) {
+            case Operator::Add: emit({0xF2, 0x0F, 0x58, 0xC1}); break; // addsd xmm0, xmm1
+            case Operator::Sub: emit({0xF2, 0x0F, 0x5C, 0xC1}); break; // subsd xmm0, xmm1
+            case Operator::Mul: emit({0xF2, 0x0F, 0x59, 0xC1}); break; // mulsd xmm0, xmm1
+            case Operator::Div:
+                emit({0x66, 0x0F, 0x57, 0xD2});       // xorpd xmm2, xmm2
+                emit({0x66, 0x0F, 0x2E, 0xCA});       // ucomisd xmm1, xmm2
+                jump_to_error_if_equal();
+                emit({0xF2, 0x0F, 0x5E, 0xC1});       // divsd xmm0, xmm1
+                break;
+            case Operator::Mod:
+                emit({0xF2, 0x0F, 0x2C, 0xC1});       // cvttsd2si eax, xmm1
+                emit({0x85, 0xC0});                   // test eax, eax
+                jump_to_error_if_equal();
+                call(reinterpret_cast<const void*>(&jit_mod));
+                break;
+            default:
+                call(reinterpret_cast<const void*>(&jit_pow));
+        }
+    }
+
+    void generate_call(const ExprNode& node) {
+        if (node.function == Function::Abs) {
+            generate(*node.children[0]);
+            emit({0x48, 0xB8}); emit_u64(0x7FFFFFFFFFFFFFFFull);  // mov rax, ~sign bit
+            emit({0x66, 0x48, 0x0F, 0x6E, 0xC8});               // movq xmm1, rax
+            emit({0x66, 0x0F, 0x54, 0xC1});                     // andpd xmm0, xmm1
+            return;
+        }
+        if (node.function == Function::Round) {
+            generate(*node.children[0]);
+            call(reinterpret_cast<const void*>(&jit_round));
+            return;
+        }
+
+        // min/max fold left to right with the same comparison as std::min/std::max
+        bool is_min = node.function == Function::Min;
+        generate(*node.children[0]);
+        for (size_t i = 1; i < node.children.size(); ++i) {
+            push_xmm0();
+            generate(*node.children[i]);
+            emit({0x66, 0x0F, 0x28, 0xC8});                     // movapd xmm1, xmm0
+            pop_xmm0();
+            emit({0xF2, 0x0F, uint8_t(is_min ? 0x5D : 0x5F), 0xC8}); // minsd/maxsd xmm1, xmm0
+            emit({0x66, 0x0F, 0x28, 0xC1});                     // movapd xmm0, xmm1
+        }
+        // An infinite (or NaN) result is reported by the interpreter
+        double infinity = std::numeric_limits<double>::infinity();
+        load_constant(is_min ? infinity : -infinity, true);
+        emit({0x66, 0x0F, 0x2E, 0xC1});                         // ucomisd xmm0, xmm1
+        jump_to_error_if_equal();
+    }
+
+public:
+    CodeGenerator(std::vector<uint8_t>& out, std::vector<JSONPath>& slots) : out(out), slots(slots) {}
+
+    void generate(const ExprNode& node) {
+        switch (node.kind) {
+            case ExprNode::Number:
+                load_constant(node.number, false);
+                break;
+            case ExprNode::Path: {
+                uint32_t offset = static_cast<uint32_t>(slot_for(node.path) * sizeof(double));
+                emit({0xF2, 0x0F, 0x10, 0x83}); emit_u32(offset);  // movsd xmm0, [rbx + offset]
+                break;
+            }
+            case ExprNode::Unary:
+                generate(*node.children[0]);
+                emit({0x48, 0xB8}); emit_u64(0x8000000000000000ull);  // mov rax, sign bit
+                emit({0x66, 0x48, 0x0F, 0x6E, 0xC8});               // movq xmm1, rax
+                emit({0x66, 0x0F, 0x57, 0xC1});                     // xorpd xmm0, xmm1
+                break;
+            case ExprNode::Binary:
+                generate_binary(node);
+                break;
+            case ExprNode::Call:
+                generate_call(node);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void generate_function(const ExprNode& root) {
+        emit({0x55});                         // push rbp
+        emit({0x48, 0x89, 0xE5});             // mov rbp, rsp
+        emit({0x53});                         // push rbx
+        emit({0x41, 0x54});                   // push r12
+        emit({0x48, 0x89, 0xFB});             // mov rbx, rdi (slots)
+        emit({0x49, 0x89, 0xF4});             // mov r12, rsi (status)
+
+        generate(root);
+
+        emit({0xE9});                         // jmp epilogue
+        size_t skip_error = out.size();
+        emit_u32(0);
+
+        size_t error_label = out.size();
+        emit({0x41, 0xC7, 0x04, 0x24}); emit_u32(1); // mov dword [r12], 1
+        for (size_t at : error_jumps) {
+            uint32_t rel = static_cast<uint32_t>(error_label - (at + 4));
+            std::memcpy(&out[at], &rel, 4);
+        }
+
+        size_t epilogue = out.size();
+        uint32_t rel = static_cast<uint32_t>(epilogue - (skip_error + 4));
+        std::memcpy(&out[skip_error], &rel, 4);
+        emit({0x48, 0x8D, 0x65, 0xF0});       // lea rsp, [rbp - 16]
+        emit({0x41, 0x5C});                   // pop r12
+        emit({0x5B});                         // pop rbx
+        emit({0x5D});                         // pop rbp
+        emit({0xC3});                         // ret
+    }
+};
+
+bool NumericJIT::is_supported() {
+#ifdef JSON_EVAL_JIT
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::unique_ptr<NumericJIT> NumericJIT::compile(const ExprNode& root) {
+    // A bare path gains nothing from native code, and the VM keeps integers exact
+    if (!is_supported() || !is_numeric(root) || root.kind == ExprNode::Path) return nullptr;
+
+    std::unique_ptr<NumericJIT> jit(new NumericJIT());
+    std::vector<uint8_t> bytes;
+    CodeGenerator generator(bytes, jit->slots);
+    generator.generate_function(root);
+
+#ifdef JSON_EVAL_JIT
+    // Written while writable, then flipped to read+execute
+    void* memory = mmap(nullptr, bytes.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return nullptr;
+    std::memcpy(memory, bytes.data(), bytes.size());
+    if (mprotect(memory, bytes.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, bytes.size());
+        return nullptr;
+    }
+    jit->code = memory;
+    jit->size = bytes.size();
+#endif
+    return jit;
+}
+
+NumericJIT::~NumericJIT() {
+#ifdef JSON_EVAL_JIT
+    if (code) munmap(code, size);
+#endif
+}
+
+bool NumericJIT::run(const double* slot_values, double& result) const {
+    using NativeFunction = double (*)(const double*, int*);
+    int status = 0;
+    NativeFunction fn = reinterpret_cast<NativeFunction>(code);
+    result = fn(slot_values, &status);
+    return status == 0;
+}
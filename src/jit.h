@@ -0,0 +1,35 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "expression.h"
+#include <memory>
+#include <vector>
+
+// Native x86-64 code for expressions that only do arithmetic on numbers:
+// literals, paths, + - * / % **, unary minus, abs, round, min and max.
+// Paths are bound to slots the caller fills with already-resolved numbers.
+class NumericJIT {
+    void* code;
+    size_t size;
+    std::vector<JSONPath> slots;
+
+    NumericJIT() : code(nullptr), size(0) {}
+
+public:
+    ~NumericJIT();
+    NumericJIT(const NumericJIT&) = delete;
+    NumericJIT& operator=(const NumericJIT&) = delete;
+
+    // Returns nullptr when the expression is not purely numeric or the platform has no JIT
+    static std::unique_ptr<NumericJIT> compile(const ExprNode& root);
+    static bool is_supported();
+
+    // Paths to resolve, in slot order
+    const std::vector<JSONPath>& get_slots() const { return slots; }
+
+    // Runs the native code. Returns false when the result needs the interpreter
+    // (division by zero, empty min/max and similar error cases).
+    bool run(const double* slot_values, double& result) const;
+};
+
+#endif
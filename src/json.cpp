@@ -1,64 +1,247 @@
 #include "json.h"
+#include "json_writer.h"
+#include "string_parser.h"
+#include "structural_parser.h"
 #include <cctype>
-#include <sstream>
+#include <algorithm>
+#include <new>
+#include <thread>
+#include <type_traits>
+
+// Vectors relocate elements by moving only if it cannot throw; a copy would leave the arena
+static_assert(std::is_nothrow_move_constructible<JSONValue>::value, "JSONValue moves must not throw");
+static_assert(sizeof(JSONValue) == 16, "Arrays and objects hold JSONValues by value");
+
+// How many shapes an object's own table may collect from insert_or_assign
+static constexpr size_t OWN_TABLE_SHAPES = 8;
+
+JSONObject::JSONObject(std::pmr::memory_resource* resource) : values(resource) {}
+
+JSONObject::JSONObject(Member* first, Member* last, std::pmr::memory_resource* resource, KeyTable& keys,
+                       std::shared_ptr<KeyTable> owner)
+    : table_owner(std::move(owner)), values(resource) {
+    auto by_key = [](const Member& a, const Member& b) { return a.first->name < b.first->name; };
+    // Stable, so of two equal keys the later one stays second. Small objects are
+    // insertion sorted, as stable_sort would allocate a buffer for each.
+    if (!std::is_sorted(first, last, by_key)) {
+        if (last - first <= 32) {
+            for (Member* i = first + 1; i < last; ++i) {
+                for (Member* j = i; j > first && by_key(*j, *(j - 1)); --j) std::swap(*j, *(j - 1));
+            }
+        } else {
+            std::stable_sort(first, last, by_key);
+        }
+    }
+
+    // Each thread reuses one buffer for the key lists it looks shapes up by
+    static thread_local std::vector<const JSONKey*> shape_keys;
+    shape_keys.clear();
+    values.reserve(static_cast<size_t>(last - first));
+    for (Member* member = first; member != last; ++member) {
+        if (member + 1 != last && member->first == (member + 1)->first) continue; // Last duplicate wins
+        shape_keys.push_back(member->first);
+        values.push_back(std::move(member->second));
+    }
+    object_shape = keys.intern_shape(shape_keys.data(), shape_keys.size());
+}
+
+JSONObject::JSONObject(const JSONObject& other)
+    : table_owner(other.table_owner), object_shape(other.object_shape), values(other.values) {
+    KeyTable* table = object_shape->table;
+    if (table_owner || !table || table == &KeyTable::shared()) return;
+    // A document's table is held by the document, and now by this copy too
+    table_owner = table->weak_from_this().lock();
+    if (table_owner) return;
+    KeyTable& shared = KeyTable::shared();
+    std::vector<const JSONKey*> keys;
+    keys.reserve(other.size());
+    for (size_t i = 0; i < other.size(); ++i) {
+        const JSONKey* key = other.object_shape->keys[i];
+        keys.push_back(shared.intern(key->name, key->hash));
+    }
+    object_shape = shared.intern_shape(keys.data(), keys.size());
+}
+
+JSONObject& JSONObject::operator=(const JSONObject& other) {
+    if (this != &other) *this = JSONObject(other);
+    return *this;
+}
+
+const JSONValue& JSONObject::at(std::string_view key) const {
+    size_t slot = object_shape->slot_of(key);
+    if (slot == size()) throw JSONError("Key not found: " + std::string(key));
+    return values[slot];
+}
+
+void JSONObject::insert_or_assign(std::string_view key, JSONValue value) {
+    const JSONKey* const* keys = object_shape->keys;
+    size_t slot = static_cast<size_t>(std::lower_bound(keys, keys + size(), key, [](const JSONKey* k, std::string_view name) {
+        return k->name < name;
+    }) - keys);
+    if (slot < size() && keys[slot]->name == key) {
+        values[slot] = std::move(value);
+        return;
+    }
+    // A new key means a new shape. Tables that other objects see are left alone, and
+    // a table of this object's own is started over before the shapes it outgrew pile up.
+    if (!table_owner || table_owner.use_count() != 1 || table_owner->shape_count() >= OWN_TABLE_SHAPES) {
+        move_to_own_table();
+    }
+    std::vector<const JSONKey*> grown(object_shape->keys, object_shape->keys + size());
+    grown.insert(grown.begin() + static_cast<ptrdiff_t>(slot), table_owner->intern(key));
+    values.insert(values.begin() + static_cast<ptrdiff_t>(slot), std::move(value));
+    object_shape = table_owner->intern_shape(grown.data(), grown.size());
+}
+
+void JSONObject::move_to_own_table() {
+    auto table = std::make_shared<KeyTable>();
+    std::vector<const JSONKey*> keys;
+    keys.reserve(size());
+    for (size_t i = 0; i < size(); ++i) keys.push_back(table->intern(object_shape->keys[i]->name, object_shape->keys[i]->hash));
+    object_shape = table->intern_shape(keys.data(), keys.size());
+    table_owner = std::move(table);
+}
+
+// Containers are placed in the resource their own allocator uses, which also frees them
+template <typename T>
+static T* make_node(T&& container) {
+    std::pmr::memory_resource* resource = container.get_allocator().resource();
+    return new (resource->allocate(sizeof(T), alignof(T))) T(std::move(container));
+}
+
+template <typename T>
+static void destroy_node(T* node) {
+    std::pmr::memory_resource* resource = node->get_allocator().resource();
+    node->~T();
+    resource->deallocate(node, sizeof(T), alignof(T));
+}
+
+// Long strings carry the resource they came from just before their characters
+void JSONValue::set_string(std::string_view s, std::pmr::memory_resource* resource) {
+    if (s.size() <= SMALL_STRING) {
+        std::memcpy(payload, s.data(), s.size());
+        state.store(static_cast<uint8_t>(s.size()), std::memory_order_relaxed);
+        type = SmallString;
+        return;
+    }
+    char* block = static_cast<char*>(resource->allocate(sizeof(resource) + s.size(), alignof(std::pmr::memory_resource*)));
+    std::memcpy(block, &resource, sizeof(resource));
+    std::memcpy(block + sizeof(resource), s.data(), s.size());
+    set_word(block + sizeof(resource));
+    set_length(s.size());
+    type = String;
+}
+
+void JSONValue::release() noexcept {
+    switch (type) {
+        case String: {
+            char* block = word<char*>() - sizeof(std::pmr::memory_resource*);
+            std::pmr::memory_resource* resource;
+            std::memcpy(&resource, block, sizeof(resource));
+            resource->deallocate(block, sizeof(resource) + length(), alignof(std::pmr::memory_resource*));
+            break;
+        }
+        case Object: destroy_node(word<JSONObject*>()); break;
+        case Array: destroy_node(word<JSONArray*>()); break;
+        case NumberArray: destroy_node(word<JSONNumberArray*>()); break;
+        default: break;
+    }
+    type = Null;
+}
+
+void JSONValue::decode() const {
+    uint8_t expected = Escaped;
+    if (state.compare_exchange_strong(expected, Decoding, std::memory_order_acquire)) {
+        // Validated while parsing, so this cannot throw; the closing quote stops it
+        char* begin = word<char*>();
+        set_length(decode_json_string_in_place(begin, begin + length() + 1));
+        state.store(Ready, std::memory_order_release);
+        return;
+    }
+    while (state.load(std::memory_order_acquire) != Ready) std::this_thread::yield();
+}
+
+// Copies of containers go to the default heap, as the copied pmr containers do
+JSONValue::JSONValue(const JSONObject& o) : state(0), type(Object) { set_word(make_node(JSONObject(o))); }
+JSONValue::JSONValue(const JSONArray& a) : state(0), type(Array) { set_word(make_node(JSONArray(a))); }
+JSONValue::JSONValue(const JSONNumberArray& a) : state(0), type(NumberArray) { set_word(make_node(JSONNumberArray(a))); }
+JSONValue::JSONValue(JSONObject&& o) : state(0), type(Object) { set_word(make_node(std::move(o))); }
+JSONValue::JSONValue(JSONArray&& a) : state(0), type(Array) { set_word(make_node(std::move(a))); }
+JSONValue::JSONValue(JSONNumberArray&& a) : state(0), type(NumberArray) { set_word(make_node(std::move(a))); }
+
+JSONValue::JSONValue(const JSONValue& other) : state(0), type(Null) {
+    switch (other.type) {
+        case SmallString:
+        case RawString:
+        case String: set_string(other.as_string(), std::pmr::get_default_resource()); break;
+        case Object: *this = JSONValue(other.as_object()); break;
+        case Array: *this = JSONValue(other.as_array()); break;
+        case NumberArray: *this = JSONValue(other.as_number_array()); break;
+        default:
+            std::memcpy(payload, other.payload, SMALL_STRING);
+            type = other.type;
+            break;
+    }
+}
+
+JSONValue& JSONValue::operator=(const JSONValue& other) {
+    if (this != &other) *this = JSONValue(other);
+    return *this;
+}
 
 bool JSONValue::as_bool() const {
-    if (is_bool()) return std::get<bool>(value);
+    if (is_bool()) return word<bool>();
     throw JSONError("Value is not a boolean");
 }
 
 double JSONValue::as_number() const {
-    if (is_number()) return std::get<double>(value);
+    if (type == Double) return word<double>();
+    if (is_integer()) return static_cast<double>(word<int64_t>());
     throw JSONError("Value is not a number");
 }
 
-const std::string& JSONValue::as_string() const {
-    if (is_string()) return std::get<std::string>(value);
-    throw JSONError("Value is not a string");
+int64_t JSONValue::as_integer() const {
+    if (is_integer()) return word<int64_t>();
+    throw JSONError("Value is not an integer");
+}
+
+std::string_view JSONValue::as_string() const {
+    switch (type) {
+        case SmallString:
+            return std::string_view(reinterpret_cast<const char*>(payload), state.load(std::memory_order_relaxed));
+        case RawString:
+            if (state.load(std::memory_order_acquire) != Ready) decode();
+            return std::string_view(word<const char*>(), length());
+        case String: return std::string_view(word<const char*>(), length());
+        default: throw JSONError("Value is not a string");
+    }
 }
 
 const JSONObject& JSONValue::as_object() const {
-    if (is_object()) return std::get<JSONObject>(value);
+    if (is_object()) return *word<const JSONObject*>();
     throw JSONError("Value is not an object");
 }
 
 const JSONArray& JSONValue::as_array() const {
-    if (is_array()) return std::get<JSONArray>(value);
+    if (type == Array) return *word<const JSONArray*>();
+    if (is_number_array()) throw JSONError("Value is a packed numeric array");
     throw JSONError("Value is not an array");
 }
 
+const JSONNumberArray& JSONValue::as_number_array() const {
+    if (is_number_array()) return *word<const JSONNumberArray*>();
+    throw JSONError("Value is not a numeric array");
+}
+
+size_t JSONValue::array_size() const {
+    if (is_number_array()) return word<const JSONNumberArray*>()->size();
+    return as_array().size();
+}
+
 std::string JSONValue::to_string() const {
-    if (is_null()) return "null";
-    if (is_bool()) return as_bool() ? "true" : "false";
-    if (is_number()) {
-        std::ostringstream oss;
-        oss << as_number();
-        return oss.str();
-    }
-    if (is_string()) return as_string();
-    if (is_array()) {
-        const JSONArray& arr = as_array();
-        std::string s = "[";
-        for (size_t i = 0; i < arr.size(); ++i) {
-            s += arr[i].to_string();
-            if (i != arr.size() - 1) s += ", ";
-        }
-        s += "]";
-        return s;
-    }
-    if (is_object()) {
-        const JSONObject& obj = as_object();
-        std::string s = "{";
-        size_t i = 0;
-        for (const auto& pair : obj) {
-            s += "\"" + pair.first + "\": " + pair.second.to_string();
-            if (i != obj.size() - 1) s += ", ";
-            ++i;
-        }
-        s += "}";
-        return s;
-    }
-    return "";
+    JSONWriter writer;
+    writer.write(*this);
+    return writer.take();
 }
 
 char JSON::peek() const {
@@ -72,144 +255,318 @@ char JSON::get() {
 }
 
 void JSON::skip_whitespace() {
-    while (std::isspace(peek())) get();
+    while (is_json_space(peek())) get();
 }
 
-JSONValue JSON::parse_value() {
-    skip_whitespace();
-    char c = peek();
-    if (c == 'n') return parse_null();
-    if (c == 't' || c == 'f') return parse_bool();
-    if (c == '-' || std::isdigit(c)) return parse_number();
-    if (c == '"') return parse_string();
-    if (c == '[') return parse_array();
-    if (c == '{') return parse_object();
-    throw JSONError("Invalid JSON value");
-}
-
-JSONValue JSON::parse_null() {
-    if (text.substr(index, 4) == "null") {
-        index += 4;
-        return JSONValue(nullptr);
-    }
-    throw JSONError("Invalid JSON null");
-}
-
-JSONValue JSON::parse_bool() {
-    if (text.substr(index, 4) == "true") {
-        index += 4;
-        return JSONValue(true);
-    } else if (text.substr(index, 5) == "false") {
-        index += 5;
-        return JSONValue(false);
-    }
-    throw JSONError("Invalid JSON boolean");
-}
-
-JSONValue JSON::parse_number() {
-    size_t start = index;
-    if (peek() == '-') get();
-    if (peek() == '0') {
-        get();
-    } else if (std::isdigit(peek())) {
-        while (std::isdigit(peek())) get();
-    } else {
-        throw JSONError("Invalid JSON number");
+// Scratch stacks left over from the last parse on this thread. A stack that grew past
+// SPARE_LIMIT elements is freed instead, so one large document does not pin its memory.
+static constexpr size_t SPARE_LIMIT = 1 << 12;
+
+template <typename T>
+static std::vector<T>& spare() {
+    static thread_local std::vector<T> stack;
+    return stack;
+}
+
+template <typename T>
+static void take_spare(std::vector<T>& stack) {
+    stack.swap(spare<T>());
+}
+
+template <typename T>
+static void give_back(std::vector<T>& stack) {
+    if (stack.capacity() > SPARE_LIMIT) return;
+    stack.clear();
+    stack.swap(spare<T>());
+}
+
+// A vector that comes from the spares and goes back when it leaves scope
+template <typename T>
+struct ScratchVector : std::vector<T> {
+    ScratchVector() { take_spare<T>(*this); }
+    ~ScratchVector() { give_back<T>(*this); }
+};
+
+JSONBuilder::JSONBuilder(std::pmr::memory_resource* resource, KeyTable* keys, std::shared_ptr<KeyTable> owner)
+    : resource(resource), keys(keys), owner(std::move(owner)) {
+    take_spare(frames);
+    take_spare(member_stack);
+    take_spare(element_stack);
+    take_spare(number_stack);
+}
+
+JSONBuilder::~JSONBuilder() {
+    give_back(frames);
+    give_back(member_stack);
+    give_back(element_stack);
+    give_back(number_stack);
+}
+
+void JSONBuilder::start(bool object) {
+    frames.push_back(Frame{object, !object, nullptr, object ? member_stack.size() : element_stack.size(), number_stack.size()});
+}
+
+void JSONBuilder::add(JSONValue&& value) {
+    if (frames.empty()) {
+        root = std::move(value);
+        return;
+    }
+    Frame& frame = frames.back();
+    if (frame.object) {
+        member_stack.emplace_back(frame.key, std::move(value));
+        return;
     }
+    if (frame.packed) {
+        // First element that is not a double: switch to the generic representation
+        frame.packed = false;
+        element_stack.insert(element_stack.end(), number_stack.begin() + frame.number_base, number_stack.end());
+        number_stack.resize(frame.number_base);
+    }
+    element_stack.push_back(std::move(value));
+}
 
-    if (peek() == '.') {
-        get();
-        if (!std::isdigit(peek())) throw JSONError("Invalid JSON number");
-        while (std::isdigit(peek())) get();
+void JSONBuilder::end() {
+    Frame frame = frames.back();
+    frames.pop_back();
+    if (frame.object) {
+        JSONObject object(member_stack.data() + frame.base, member_stack.data() + member_stack.size(), resource, *keys,
+                          owner);
+        member_stack.resize(frame.base);
+        add(JSONValue(std::move(object)));
+    } else if (frame.packed && number_stack.size() > frame.number_base) {
+        JSONNumberArray numbers(number_stack.begin() + frame.number_base, number_stack.end(), resource);
+        number_stack.resize(frame.number_base);
+        add(JSONValue(std::move(numbers)));
+    } else {
+        JSONArray array(std::make_move_iterator(element_stack.begin() + frame.base),
+                        std::make_move_iterator(element_stack.end()), resource);
+        element_stack.erase(element_stack.begin() + frame.base, element_stack.end());
+        add(JSONValue(std::move(array)));
     }
+}
 
-    double number = std::stod(text.substr(start, index - start));
-    return JSONValue(number); // Ensure the number is stored as double
+JSONRawString JSON::read_raw_string() {
+    get(); // skip '"'
+    char* begin = const_cast<char*>(text.data()) + index; // Writable, see lazy_strings
+    bool escaped;
+    const char* end = scan_json_string(begin, text.data() + text.size(), escaped);
+    index += static_cast<size_t>(end - begin);
+    return JSONRawString{begin, static_cast<size_t>(end - begin) - 1, escaped};
 }
 
+std::string_view JSON::read_string() {
+    get(); // skip '"'
+    const char* begin = text.data() + index;
+    string_buffer.clear();
+    index += static_cast<size_t>(parse_json_string(begin, text.data() + text.size(), string_buffer) - begin);
+    return string_buffer;
+}
 
-JSONValue JSON::parse_string() {
+const JSONKey* JSON::read_key() {
     get(); // skip '"'
-    std::string s;
-    while (peek() != '"' && peek() != '\0') {
-        if (peek() == '\\') {
-            get();
-            char escaped = get();
-            switch (escaped) {
-                case '"': s += '"'; break;
-                case '\\': s += '\\'; break;
-                case '/': s += '/'; break;
-                case 'b': s += '\b'; break;
-                case 'f': s += '\f'; break;
-                case 'n': s += '\n'; break;
-                case 'r': s += '\r'; break;
-                case 't': s += '\t'; break;
-                default: throw JSONError("Invalid escape character");
-            }
-        } else {
-            s += get();
+    const JSONKey* key;
+    const char* begin = text.data() + index;
+    index += static_cast<size_t>(parse_json_key(begin, text.data() + text.size(), *keys, key, string_buffer) - begin);
+    return key;
+}
+
+ParsedNumber JSON::read_number() {
+    ParsedNumber number;
+    const char* begin = text.data() + index;
+    index += static_cast<size_t>(parse_json_number(begin, text.data() + text.size(), number) - begin);
+    return number;
+}
+
+void JSON::read_literal(std::string_view word, const char* error) {
+    if (text.substr(index, word.size()) != word) throw JSONError(error);
+    index += word.size();
+}
+
+// Builds the tree, with strings decoded or left raw and keys interned. Events read
+// their own strings and keys, as each kind of events wants them in another form.
+struct JSON::TreeEvents {
+    JSON& parser;
+    JSONBuilder& builder;
+
+    bool null() { return add(JSONValue(nullptr)); }
+    bool boolean(bool b) { return add(JSONValue(b)); }
+    bool number(const ParsedNumber& number) {
+        if (builder.packed() && is_exact_double(number)) {
+            builder.add_number(number.number);
+            return true;
         }
+        return add(number.is_integer ? JSONValue(number.integer) : JSONValue(number.number));
     }
-    if (get() != '"') throw JSONError("Unterminated string");
-    return JSONValue(s);
-}
+    bool string() {
+        if (parser.lazy_strings) return add(JSONValue(parser.read_raw_string()));
+        return add(JSONValue(parser.read_string(), parser.resource));
+    }
+    bool key() {
+        builder.key(parser.read_key());
+        return true;
+    }
+    bool start_object() { return start(true); }
+    bool end_object() { return end(); }
+    bool start_array() { return start(false); }
+    bool end_array() { return end(); }
 
-JSONValue JSON::parse_array() {
-    get(); // skip '['
-    JSONArray array;
-    skip_whitespace();
-    if (peek() == ']') {
-        get();
-        return JSONValue(array);
+    bool add(JSONValue&& value) {
+        builder.add(std::move(value));
+        return true;
     }
-    while (true) {
-        JSONValue val = parse_value();
-        array.push_back(val);
-        skip_whitespace();
-        if (peek() == ',') {
-            get();
-        } else if (peek() == ']') {
-            get();
-            break;
-        } else {
-            throw JSONError("Expected ',' or ']'");
-        }
+    bool start(bool object) {
+        builder.start(object);
+        return true;
     }
-    return JSONValue(array);
-}
+    bool end() {
+        builder.end();
+        return true;
+    }
+};
 
-JSONValue JSON::parse_object() {
-    get(); // skip '{'
-    JSONObject object;
-    skip_whitespace();
-    if (peek() == '}') {
-        get();
-        return JSONValue(object);
+// Forwards to a JSONHandler, with strings and keys decoded
+struct JSON::HandlerEvents {
+    JSON& parser;
+    JSONHandler& handler;
+
+    bool null() { return handler.null(); }
+    bool boolean(bool b) { return handler.boolean(b); }
+    bool number(const ParsedNumber& number) {
+        return number.is_integer ? handler.integer(number.integer) : handler.number(number.number);
     }
+    bool string() { return handler.string(parser.read_string()); }
+    bool key() { return handler.key(parser.read_string()); }
+    bool start_object() { return handler.start_object(); }
+    bool end_object() { return handler.end_object(); }
+    bool start_array() { return handler.start_array(); }
+    bool end_array() { return handler.end_array(); }
+};
+
+template <class Events>
+bool JSON::read_member_key(Events& events) {
+    skip_whitespace();
+    if (peek() != '"') throw JSONError("Expected string key");
+    bool go_on = events.key();
+    skip_whitespace();
+    if (get() != ':') throw JSONError("Expected ':'");
+    return go_on;
+}
+
+template <class Events>
+bool JSON::walk(Events& events) {
+    ScratchVector<char> closers; // Of every open container, innermost last
     while (true) {
         skip_whitespace();
-        if (peek() != '"') throw JSONError("Expected string key");
-        JSONValue key = parse_string();
-        skip_whitespace();
-        if (get() != ':') throw JSONError("Expected ':'");
-        skip_whitespace();
-        JSONValue val = parse_value();
-        object[key.as_string()] = val;
-        skip_whitespace();
-        if (peek() == ',') {
+        char c = peek();
+        bool go_on;
+        if (c == '[' || c == '{') {
             get();
-        } else if (peek() == '}') {
+            if (closers.size() >= max_depth) throw JSONError("Maximum nesting depth exceeded");
+            bool object = c == '{';
+            if (!(object ? events.start_object() : events.start_array())) return false;
+            closers.push_back(object ? '}' : ']');
+            skip_whitespace();
+            if (peek() != closers.back()) {
+                if (object && !read_member_key(events)) return false;
+                continue;
+            }
             get();
-            break;
+            closers.pop_back();
+            go_on = object ? events.end_object() : events.end_array();
+        } else if (c == '"') {
+            go_on = events.string();
+        } else if (c == '-' || std::isdigit(c)) {
+            go_on = events.number(read_number());
+        } else if (c == 'n') {
+            read_literal("null", "Invalid JSON null");
+            go_on = events.null();
+        } else if (c == 't') {
+            read_literal("true", "Invalid JSON boolean");
+            go_on = events.boolean(true);
+        } else if (c == 'f') {
+            read_literal("false", "Invalid JSON boolean");
+            go_on = events.boolean(false);
         } else {
-            throw JSONError("Expected ',' or '}'");
+            throw JSONError("Invalid JSON value");
         }
+        if (!go_on) return false;
+
+        // Separators and closers up to the next value
+        while (true) {
+            if (closers.empty()) return true;
+            bool object = closers.back() == '}';
+            skip_whitespace();
+            char next = get();
+            if (next == ',') {
+                if (object && !read_member_key(events)) return false;
+                break;
+            }
+            if (next != closers.back()) throw JSONError(object ? "Expected ',' or '}'" : "Expected ',' or ']'");
+            closers.pop_back();
+            if (!(object ? events.end_object() : events.end_array())) return false;
+        }
+    }
+}
+
+JSONValue JSON::parse_value() {
+    if (!keys) {
+        own_keys = std::make_shared<KeyTable>();
+        keys = own_keys.get();
     }
-    return JSONValue(object);
+    JSONBuilder builder(resource, keys, own_keys);
+    TreeEvents events{*this, builder};
+    walk(events);
+    return builder.take();
 }
 
-JSONValue JSON::parse(const std::string& text) {
-    JSON parser(text);
+JSONValue JSON::parse(std::string_view text, std::pmr::memory_resource* resource, bool lazy_strings, KeyTable* keys,
+                      size_t max_depth) {
+    JSON parser(text, resource, lazy_strings, keys, max_depth);
     return parser.parse_value();
 }
 
+bool JSON::parse_events(std::string_view text, JSONHandler& handler, size_t max_depth, bool whole_text) {
+    JSON parser(text, std::pmr::get_default_resource(), false, nullptr, max_depth);
+    HandlerEvents events{parser, handler};
+    if (!parser.walk(events)) return false;
+    if (whole_text) {
+        parser.skip_whitespace();
+        if (parser.index < text.size()) throw JSONError("Unexpected content after JSON value");
+    }
+    return true;
+}
+
+JSONDocumentPtr JSONDocument::parse(std::string_view text, Allocation allocation, Backend backend, Strings strings,
+                                    size_t max_depth, std::shared_ptr<KeyTable> shared_keys) {
+    bool lazy = strings == Lazy;
+    auto document = std::make_shared<JSONDocument>(nullptr);
+    document->key_table = shared_keys ? std::move(shared_keys) : std::make_shared<KeyTable>();
+    KeyTable* keys = document->key_table.get();
+    auto parse_with = [&](std::pmr::memory_resource* resource) {
+        if (backend == Structural) return StructuralParser::parse(text, resource, lazy, keys, max_depth);
+        return JSON::parse(text, resource, lazy, keys, max_depth);
+    };
+
+    if (allocation == Arena) {
+        document->arena = std::make_unique<std::pmr::monotonic_buffer_resource>(std::max<size_t>(text.size(), 4096));
+    }
+    if (lazy) {
+        // Lazy strings point into this copy and are decoded over it, so it must be ours
+        char* copy = allocation == Arena ? static_cast<char*>(document->arena->allocate(text.size(), 1))
+                                         : (document->source = std::make_unique<char[]>(text.size())).get();
+        std::copy(text.begin(), text.end(), copy);
+        text = std::string_view(copy, text.size());
+    }
+
+    if (allocation == Heap) {
+        document->value = parse_with(std::pmr::get_default_resource()); // Moved in, not copied
+        return document;
+    }
+
+    // Moves keep the arena as the owner, so the root can be placed in the arena too.
+    // Its destructor never runs: everything it owns is freed with the arena.
+    JSONValue root = parse_with(document->arena.get());
+    void* slot = document->arena->allocate(sizeof(JSONValue), alignof(JSONValue));
+    document->tree = new (slot) JSONValue(std::move(root));
+    return document;
+}
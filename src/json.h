@@ -2,10 +2,18 @@
 #define JSON_H
 
 #include <string>
-#include <map>
+#include <atomic>
 #include <vector>
+#include <iterator>
 #include <variant>
 #include <exception>
+#include <memory>
+#include <memory_resource>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include "key_table.h"
+#include "number_parser.h"
 
 class JSONError : public std::exception {
     std::string message;
@@ -16,57 +24,359 @@ public:
 
 class JSONValue;
 
-using JSONObject = std::map<std::string, JSONValue>;
-using JSONArray = std::vector<JSONValue>;
+// Containers take a memory resource so a whole document can live in one arena.
+// Moves keep the source's resource; copies always go to the default (global) heap.
+using JSONString = std::pmr::string;
+using JSONArray = std::pmr::vector<JSONValue>;
+// Arrays holding only numbers are parsed into this packed form instead of a JSONArray
+using JSONNumberArray = std::pmr::vector<double>;
 
+// An object is a shape, its sorted key set shared with every object that has the
+// same keys, plus its values in the shape's order. Keys are interned (see KeyTable),
+// so they compare by pointer, and sorted by name, which is also the output order.
+class JSONObject {
+public:
+    // What parsers collect before the object is made
+    using Member = std::pair<const JSONKey*, JSONValue>;
+
+    // Iteration yields key/value pairs put together from the shape and the values
+    class const_iterator {
+        const JSONObject* object;
+        size_t slot;
+    public:
+        struct Entry {
+            const JSONKey* first;
+            const JSONValue& second;
+            const Entry* operator->() const { return this; }
+        };
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Entry;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Entry;
+        using reference = Entry;
+
+        const_iterator(const JSONObject* object, size_t slot) : object(object), slot(slot) {}
+        Entry operator*() const;
+        Entry operator->() const { return **this; }
+        const_iterator& operator++() { ++slot; return *this; }
+        const_iterator operator++(int) { const_iterator previous = *this; ++slot; return previous; }
+        bool operator==(const const_iterator& other) const { return slot == other.slot && object == other.object; }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+    };
+
+private:
+    // Keeps the shape's table alive when nothing else does: set for copies and for plain
+    // parses, but not in documents, which own their table
+    std::shared_ptr<KeyTable> table_owner;
+    const JSONShape* object_shape = &JSONShape::empty();
+    std::pmr::vector<JSONValue> values;
+
+    void move_to_own_table();
+
+public:
+    explicit JSONObject(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    // Moves the members out of a parser's scratch stack, which it may reorder, and
+    // finds their shape in keys. They may come in any order; of duplicate keys, the last one wins.
+    // owner, when given, is what keeps keys alive.
+    JSONObject(Member* first, Member* last, std::pmr::memory_resource* resource, KeyTable& keys,
+               std::shared_ptr<KeyTable> owner = nullptr);
+    // Copies keep the source's shape and hold on to its table. Only a table the caller
+    // owns, which may go first, has its keys copied over into KeyTable::shared().
+    JSONObject(const JSONObject& other);
+    JSONObject(JSONObject&& other) noexcept = default;
+    JSONObject& operator=(const JSONObject& other);
+    JSONObject& operator=(JSONObject&& other) noexcept = default;
+
+    std::pmr::polymorphic_allocator<JSONValue> get_allocator() const { return values.get_allocator(); }
+    const JSONShape& shape() const { return *object_shape; }
+    const JSONValue& value_at(size_t slot) const;
+    size_t size() const { return object_shape->size; }
+    bool empty() const { return object_shape->size == 0; }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, object_shape->size); }
+    const_iterator find(std::string_view key) const { return const_iterator(this, object_shape->slot_of(key)); }
+    // Compares pointers only; key must come from the table this object's keys came from
+    const_iterator find(const JSONKey* key) const { return const_iterator(this, object_shape->slot_of(key)); }
+    size_t count(std::string_view key) const { return find(key) != end(); }
+    const JSONValue& at(std::string_view key) const;
+
+    // Linear in the object size; parsers build the member vector first instead.
+    // A new key and the grown shape go to a table of this object's own, never a shared one.
+    void insert_or_assign(std::string_view key, JSONValue value);
+};
+
+// A string value left undecoded in its document's private copy of the input, as
+// parsers hand it to JSONValue. Slices without escapes are served as they are; the
+// others are decoded over their own bytes on first access, exactly once even when readers race.
+struct JSONRawString {
+    char* begin;   // Just past the opening quote
+    size_t length; // Up to the closing quote
+    bool escaped;
+};
+
+// Sixteen bytes whatever it holds. Scalars and strings of up to 14 bytes live in the
+// value itself; longer strings and containers are allocated from the resource they
+// were built with and owned through a pointer.
 class JSONValue {
-    std::variant<std::nullptr_t, bool, double, std::string, JSONObject, JSONArray> value;
+    enum Type : uint8_t { Null, Bool, Double, Integer, SmallString, RawString, String, Object, Array, NumberArray };
+    enum RawState : uint8_t { Escaped, Decoding, Ready };
+    static constexpr size_t SMALL_STRING = 14;
+
+    // Bytes 0-7 hold a scalar or a pointer and bytes 8-13 a string length,
+    // unless they hold the characters of a small string
+    alignas(8) mutable unsigned char payload[SMALL_STRING];
+    mutable std::atomic<uint8_t> state; // A raw string's RawState, publishing its length; a small string's length
+    Type type;
+
+    template <typename T> T word() const {
+        T v;
+        std::memcpy(&v, payload, sizeof(T));
+        return v;
+    }
+    template <typename T> void set_word(T v) { std::memcpy(payload, &v, sizeof(T)); }
+    size_t length() const {
+        uint32_t low;
+        uint16_t high;
+        std::memcpy(&low, payload + 8, sizeof(low));
+        std::memcpy(&high, payload + 12, sizeof(high));
+        return static_cast<size_t>(high) << 32 | low;
+    }
+    void set_length(size_t n) const {
+        uint32_t low = static_cast<uint32_t>(n);
+        uint16_t high = static_cast<uint16_t>(n >> 32);
+        std::memcpy(payload + 8, &low, sizeof(low));
+        std::memcpy(payload + 12, &high, sizeof(high));
+    }
+    void set_string(std::string_view s, std::pmr::memory_resource* resource);
+    void decode() const;
+    void release() noexcept;
+    void take(JSONValue& other) noexcept {
+        std::memcpy(payload, other.payload, SMALL_STRING);
+        state.store(other.state.load(std::memory_order_acquire), std::memory_order_relaxed);
+        type = other.type;
+        other.type = Null;
+    }
+
 public:
-    JSONValue() : value(nullptr) {}
-    JSONValue(std::nullptr_t) : value(nullptr) {}
-    JSONValue(bool b) : value(b) {}
-    JSONValue(double d) : value(d) {}
-    JSONValue(const std::string& s) : value(s) {}
-    JSONValue(const char* s) : value(std::string(s)) {}
-    JSONValue(const JSONObject& o) : value(o) {}
-    JSONValue(const JSONArray& a) : value(a) {}
-
-    bool is_null() const { return std::holds_alternative<std::nullptr_t>(value); }
-    bool is_bool() const { return std::holds_alternative<bool>(value); }
-    bool is_number() const { return std::holds_alternative<double>(value); }
-    bool is_string() const { return std::holds_alternative<std::string>(value); }
-    bool is_object() const { return std::holds_alternative<JSONObject>(value); }
-    bool is_array() const { return std::holds_alternative<JSONArray>(value); }
+    JSONValue() : state(0), type(Null) {}
+    JSONValue(std::nullptr_t) : JSONValue() {}
+    JSONValue(bool b) : state(0), type(Bool) { set_word(b); }
+    JSONValue(double d) : state(0), type(Double) { set_word(d); }
+    JSONValue(int64_t i) : state(0), type(Integer) { set_word(i); }
+    JSONValue(int i) : JSONValue(static_cast<int64_t>(i)) {}
+    // Long strings are copied into resource
+    JSONValue(std::string_view s, std::pmr::memory_resource* resource) : state(0), type(Null) { set_string(s, resource); }
+    JSONValue(const std::string& s) : JSONValue(s, std::pmr::get_default_resource()) {}
+    JSONValue(const char* s) : JSONValue(s, std::pmr::get_default_resource()) {}
+    JSONValue(const JSONString& s) : JSONValue(s, std::pmr::get_default_resource()) {}
+    JSONValue(JSONString&& s) : JSONValue(s, s.get_allocator().resource()) {}
+    JSONValue(const JSONObject& o);
+    JSONValue(const JSONArray& a);
+    JSONValue(const JSONNumberArray& a);
+    // Adopt the container and its memory resource
+    JSONValue(JSONObject&& o);
+    JSONValue(JSONArray&& a);
+    JSONValue(JSONNumberArray&& a);
+    JSONValue(const JSONRawString& s) : state(s.escaped ? Escaped : Ready), type(RawString) {
+        set_word(s.begin);
+        set_length(s.length);
+    }
+    ~JSONValue() {
+        if (type >= String) release();
+    }
+
+    // Copies are independent of the source document, so raw strings are decoded into a string
+    JSONValue(const JSONValue& other);
+    JSONValue& operator=(const JSONValue& other);
+    JSONValue(JSONValue&& other) noexcept { take(other); }
+    JSONValue& operator=(JSONValue&& other) noexcept {
+        if (this != &other) {
+            if (type >= String) release();
+            take(other);
+        }
+        return *this;
+    }
+
+    bool is_null() const { return type == Null; }
+    bool is_bool() const { return type == Bool; }
+    // Integers are numbers too; as_number() converts them, as_integer() keeps them exact
+    bool is_number() const { return type == Double || type == Integer; }
+    bool is_integer() const { return type == Integer; }
+    // Small, long and raw strings look the same from outside
+    bool is_string() const { return type == SmallString || type == RawString || type == String; }
+    bool is_object() const { return type == Object; }
+    // True for both array representations; as_array() only serves the generic one
+    bool is_array() const { return type == Array || type == NumberArray; }
+    bool is_number_array() const { return type == NumberArray; }
 
     bool as_bool() const;
     double as_number() const;
-    const std::string& as_string() const;
+    int64_t as_integer() const;
+    std::string_view as_string() const;
     const JSONObject& as_object() const;
     const JSONArray& as_array() const;
+    const JSONNumberArray& as_number_array() const;
+    size_t array_size() const;
 
+    // Compact JSON text; JSONWriter streams or pretty-prints instead
     std::string to_string() const;
 
     friend class JSON;
 };
 
+inline const JSONValue& JSONObject::value_at(size_t slot) const { return values[slot]; }
+inline JSONObject::const_iterator::Entry JSONObject::const_iterator::operator*() const {
+    return Entry{object->object_shape->keys[slot], object->values[slot]};
+}
+
+// Space, tab, line feed and carriage return; unlike std::isspace, not \f or \v
+inline bool is_json_space(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+// Parsers reject containers nested deeper than this unless given another limit.
+// Parsing itself uses no call stack per level; destroying, copying and writing a tree still do.
+constexpr size_t JSON_MAX_DEPTH = 1024;
+
+// Assembles a tree from container boundaries and values in document order, for both
+// parsers. Open containers live on its own stacks instead of the call stack, and their
+// members and elements share scratch space, so each container is allocated once, at its final size.
+class JSONBuilder {
+    struct Frame {
+        bool object;
+        bool packed;        // An array whose elements so far are all numbers, kept on number_stack
+        const JSONKey* key; // Of the member being parsed
+        size_t base;        // Where its members or elements start
+        size_t number_base;
+    };
+    std::pmr::memory_resource* resource;
+    KeyTable* keys;
+    std::shared_ptr<KeyTable> owner; // Given to each object, unless the caller keeps keys alive
+    std::vector<Frame> frames;
+    std::vector<JSONObject::Member> member_stack;
+    std::vector<JSONValue> element_stack;
+    std::vector<double> number_stack;
+    JSONValue root;
+
+public:
+    // The stacks are taken over from the last builder on this thread and handed back on
+    // destruction, so a run of small documents does not grow new ones for each
+    JSONBuilder(std::pmr::memory_resource* resource, KeyTable* keys, std::shared_ptr<KeyTable> owner = nullptr);
+    ~JSONBuilder();
+    JSONBuilder(const JSONBuilder&) = delete;
+    JSONBuilder& operator=(const JSONBuilder&) = delete;
+
+    size_t depth() const { return frames.size(); }
+    bool in_object() const { return frames.back().object; }
+    // Numbers for a packed array go to add_number() instead of add()
+    bool packed() const { return !frames.empty() && frames.back().packed; }
+
+    void start(bool object);
+    void key(const JSONKey* key) { frames.back().key = key; }
+    void add(JSONValue&& value); // To the innermost open container, or as the root
+    void add_number(double number) { number_stack.push_back(number); }
+    void end(); // Closes the innermost container and adds it to its parent
+    JSONValue take() { return std::move(root); }
+};
+
+// Receives a document as a stream of events instead of a tree, from JSON::parse_events.
+// Strings and keys arrive decoded and are only valid during the call. Every callback
+// returns whether to go on; returning false stops the parse there.
+class JSONHandler {
+public:
+    virtual ~JSONHandler() = default;
+    virtual bool null() { return true; }
+    virtual bool boolean(bool) { return true; }
+    virtual bool integer(int64_t) { return true; } // Numbers written without fraction or exponent that fit
+    virtual bool number(double) { return true; }
+    virtual bool string(std::string_view) { return true; }
+    virtual bool start_object() { return true; }
+    virtual bool key(std::string_view) { return true; }
+    virtual bool end_object() { return true; }
+    virtual bool start_array() { return true; }
+    virtual bool end_array() { return true; }
+};
+
+// Immutable parse result with shared ownership. Evaluators hold a JSONDocumentPtr,
+// so one parse can back any number of evaluators and threads without copying the tree.
+class JSONDocument {
+public:
+    // Arena documents allocate the whole tree from a few large blocks that are
+    // released together, without visiting the nodes.
+    enum Allocation { Heap, Arena };
+    // Character walks the input with JSON; Structural indexes it first with StructuralParser
+    enum Backend { Character, Structural };
+    // Lazy documents keep a private copy of the input and leave string values in it,
+    // undecoded, until they are read
+    enum Strings { Decoded, Lazy };
+
+private:
+    // Declared before the tree so they outlive it
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> arena;
+    std::unique_ptr<char[]> source;      // Input copy behind lazy strings in heap documents
+    std::shared_ptr<KeyTable> key_table; // Keys of parsed documents
+    JSONValue value;
+    const JSONValue* tree = &value; // value, or a root placed in the arena and never destroyed
+
+public:
+    explicit JSONDocument(const JSONValue& root) : value(root) {}
+    JSONDocument(const JSONDocument&) = delete;
+    JSONDocument& operator=(const JSONDocument&) = delete;
+
+    // keys, when given, is used instead of a table of the document's own, so documents parsed
+    // one after another share keys and shapes. It must not be read while another parse fills it.
+    static std::shared_ptr<const JSONDocument> parse(std::string_view text, Allocation allocation = Heap,
+                                                     Backend backend = Character, Strings strings = Decoded,
+                                                     size_t max_depth = JSON_MAX_DEPTH,
+                                                     std::shared_ptr<KeyTable> keys = nullptr);
+    const JSONValue& root() const { return *tree; }
+    // The table every object key in a parsed tree comes from; KeyTable::shared() for the others,
+    // whose objects carry their own
+    const KeyTable& keys() const { return key_table ? *key_table : KeyTable::shared(); }
+};
+
+using JSONDocumentPtr = std::shared_ptr<const JSONDocument>;
+
 class JSON {
-    const std::string& text;
+    std::string_view text; // Not copied; must stay valid while parsing
     size_t index;
+    std::pmr::memory_resource* resource; // Every string and container in the tree comes from here
+    bool lazy_strings;                   // String values stay raw, over text
+    KeyTable* keys;                      // Where object keys are interned
+    std::shared_ptr<KeyTable> own_keys;  // keys, when the caller gave none
+    size_t max_depth;
+    JSONString string_buffer; // Decoding space for strings and keys with escapes
+
+    // What walk() reports its events to: a JSONBuilder, or a JSONHandler
+    struct TreeEvents;
+    struct HandlerEvents;
 
     char peek() const;
     char get();
     void skip_whitespace();
+    JSONRawString read_raw_string(); // Validated but not decoded
+    std::string_view read_string();  // Decoded into string_buffer
+    const JSONKey* read_key();
+    ParsedNumber read_number();
+    void read_literal(std::string_view word, const char* error);
+    template <class Events> bool read_member_key(Events& events);
+    // The tokenizer: one loop over the input, with open containers on an explicit stack
+    template <class Events> bool walk(Events& events);
 
 public:
-    JSON(const std::string& text) : text(text), index(0) {}
-    static JSONValue parse(const std::string& text);
+    // With lazy_strings, text must be writable and outlive the tree; JSONDocument arranges both.
+    // keys must outlive the tree too; by default the tree gets a table of its own, which
+    // its objects keep alive.
+    JSON(std::string_view text, std::pmr::memory_resource* resource = std::pmr::get_default_resource(),
+         bool lazy_strings = false, KeyTable* keys = nullptr, size_t max_depth = JSON_MAX_DEPTH)
+        : text(text), index(0), resource(resource), lazy_strings(lazy_strings), keys(keys), max_depth(max_depth) {}
+    static JSONValue parse(std::string_view text, std::pmr::memory_resource* resource = std::pmr::get_default_resource(),
+                           bool lazy_strings = false, KeyTable* keys = nullptr, size_t max_depth = JSON_MAX_DEPTH);
+    // Reports the first value in text to handler without building a tree, in memory bounded
+    // by max_depth and the longest escaped string. Returns false if the handler stopped it.
+    // With whole_text, anything but whitespace after the value is an error, reported after
+    // the value's own events.
+    static bool parse_events(std::string_view text, JSONHandler& handler, size_t max_depth = JSON_MAX_DEPTH,
+                             bool whole_text = false);
     JSONValue parse_value();
-    JSONValue parse_null();
-    JSONValue parse_bool();
-    JSONValue parse_number();
-    JSONValue parse_string();
-    JSONValue parse_array();
-    JSONValue parse_object();
 };
 
 
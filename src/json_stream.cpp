@@ -0,0 +1,173 @@
+#include "json_stream.h"
+#include <cstring>
+
+// A root number or literal runs to the next delimiter, so its text may hold more than
+// one token ("12ab"). JSON would stop after the first; the structural parser rejects the rest.
+static bool is_atom(std::string_view text) {
+    return text.front() != '{' && text.front() != '[' && text.front() != '"';
+}
+
+void JSONStream::complete(size_t end) {
+    if (framing == Lines) {
+        value_end = end; // Handed out at the newline, once the rest of the line is known
+        return;
+    }
+    ready.push_back(Value{value_begin, end, 0, false});
+    value_begin = NONE;
+}
+
+void JSONStream::scan_until(size_t end) {
+    const char* data = buffer.data();
+    for (; scanned < end; ++scanned) {
+        char c = data[scanned];
+        if (in_string) {
+            if (escaped) {
+                escaped = false;
+                continue;
+            }
+            // Most of a string is plain characters
+            while (c != '"' && c != '\\' && ++scanned < end) c = data[scanned];
+            if (scanned == end) break;
+            if (c == '\\') {
+                escaped = true;
+            } else {
+                in_string = false;
+                if (depth == 0) complete(scanned + 1);
+            }
+            continue;
+        }
+        bool space = is_json_space(c);
+        if (in_atom) {
+            if (!space && c != '{' && c != '[' && c != '}' && c != ']' && c != ',' && c != ':' && c != '"') continue;
+            in_atom = false;
+            complete(scanned); // c belongs to whatever follows
+        }
+        if (space) continue;
+        if (value_end != NONE) {
+            skip_line = true; // Another value on the line
+            return;
+        }
+        if (value_begin == NONE) value_begin = scanned;
+        if (c == '"') {
+            in_string = true;
+        } else if (c == '{' || c == '[') {
+            if (++depth > max_depth) {
+                if (framing == Values) throw JSONError("Maximum nesting depth exceeded");
+                skip_line = true; // The parse of the line stops at the same depth
+                return;
+            }
+        } else if (c == '}' || c == ']') {
+            // A stray closer at the root becomes a value of its own, for the parser to reject
+            if (depth > 0) --depth;
+            if (depth == 0) complete(scanned + 1);
+        } else if (depth == 0) {
+            in_atom = true;
+        }
+    }
+}
+
+void JSONStream::scan() {
+    if (framing == Values) {
+        scan_until(buffer.size());
+        return;
+    }
+    // Every newline ends a line, even inside a string, where a raw newline is invalid anyway
+    while (scanned < buffer.size()) {
+        const char* data = buffer.data();
+        const void* newline = std::memchr(data + scanned, '\n', buffer.size() - scanned);
+        size_t end = newline ? static_cast<size_t>(static_cast<const char*>(newline) - data) : buffer.size();
+        if (!skip_line) scan_until(end);
+        scanned = end; // Past whatever an error left unscanned
+        if (!newline) return;
+        end_line(end);
+        ++scanned;
+    }
+}
+
+void JSONStream::end_line(size_t end) {
+    if (in_atom) {
+        in_atom = false;
+        complete(end);
+    }
+    // A value still open is handed out truncated, for its parse to report
+    if (value_begin != NONE) {
+        bool trailing = value_end != NONE && skip_line;
+        ready.push_back(Value{value_begin, value_end != NONE ? value_end : end, line, trailing});
+    }
+    value_begin = NONE;
+    value_end = NONE;
+    depth = 0;
+    in_string = false;
+    escaped = false;
+    skip_line = false;
+    ++line;
+}
+
+void JSONStream::feed(std::string_view chunk) {
+    // Drop what has been handed out; the values not yet taken stay
+    size_t keep = !ready.empty() ? ready.front().begin : value_begin != NONE ? value_begin : scanned;
+    if (keep > 0) {
+        buffer.erase(0, keep);
+        scanned -= keep;
+        if (value_begin != NONE) value_begin -= keep;
+        if (value_end != NONE) value_end -= keep;
+        for (Value& value : ready) {
+            value.begin -= keep;
+            value.end -= keep;
+        }
+    }
+    buffer.append(chunk.data(), chunk.size());
+    scan();
+}
+
+void JSONStream::finish() {
+    if (framing == Lines) {
+        end_line(buffer.size()); // The last line needs no newline
+        return;
+    }
+    in_atom = false;
+    if (value_begin != NONE) complete(buffer.size());
+}
+
+bool JSONStream::take(std::string_view& text, bool& trailing) {
+    if (ready.empty()) return false;
+    Value value = ready.front();
+    ready.pop_front();
+    taken_line = value.line;
+    trailing = value.trailing;
+    text = std::string_view(buffer).substr(value.begin, value.end - value.begin);
+    return true;
+}
+
+static const char* const TRAILING_ERROR = "Unexpected content after JSON value";
+
+bool JSONStream::next(std::string_view& text) {
+    bool trailing;
+    if (!take(text, trailing)) return false;
+    if (trailing) throw JSONError(TRAILING_ERROR);
+    return true;
+}
+
+JSONDocumentPtr JSONStream::next_document(JSONDocument::Allocation allocation, JSONDocument::Backend backend,
+                                          JSONDocument::Strings strings) {
+    std::string_view text;
+    bool trailing;
+    if (!take(text, trailing)) return nullptr;
+    if (is_atom(text)) backend = JSONDocument::Structural;
+    if (key_mode == Shared && (!keys || keys->size() > SHARED_KEY_LIMIT || keys->shape_count() > SHARED_KEY_LIMIT)) {
+        keys = std::make_shared<KeyTable>();
+    }
+    JSONDocumentPtr document = JSONDocument::parse(text, allocation, backend, strings, max_depth,
+                                                   key_mode == Shared ? keys : nullptr);
+    if (trailing) throw JSONError(TRAILING_ERROR);
+    return document;
+}
+
+bool JSONStream::next_events(JSONHandler& handler) {
+    std::string_view text;
+    bool trailing;
+    if (!take(text, trailing)) return false;
+    // Rejects "12ab", which the scan hands out whole
+    if (JSON::parse_events(text, handler, max_depth, true) && trailing) throw JSONError(TRAILING_ERROR);
+    return true;
+}
@@ -0,0 +1,91 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include "json.h"
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Push parser for JSON that arrives in chunks of any size, such as from a pipe.
+// feed() appends a chunk and resumes a scan for the end of the current value, so
+// every value can be taken as soon as its last byte is in, without waiting for the
+// rest of the input. The scan only finds boundaries; each value is parsed by the
+// usual parsers when it is taken, so errors surface there.
+class JSONStream {
+public:
+    // Values lets values follow each other separated by whitespace or nothing; a value
+    // is ready on its last byte, and one left open takes in everything after it.
+    // Lines (NDJSON) makes each line one value, ready at its newline, so a bad line is
+    // reported on its own and the next line starts afresh. Blank lines are skipped.
+    enum Framing { Values, Lines };
+    // Separate gives every document a key table of its own. Shared interns the keys of
+    // every document from this stream into one table, so records with the same fields
+    // share their keys and shapes and the inline caches of compiled paths keep hitting.
+    // The table grows while later values are parsed, so with Shared, a document must not
+    // be read on another thread while the stream parses the next one.
+    enum Keys { Separate, Shared };
+
+private:
+    static constexpr size_t NONE = static_cast<size_t>(-1);
+    // A shared table holding more keys or shapes than this is replaced by a fresh one,
+    // so input whose keys keep changing cannot grow it without bound
+    static constexpr size_t SHARED_KEY_LIMIT = 1 << 16;
+
+    struct Value {
+        size_t begin, end; // Offsets into buffer
+        size_t line;       // With Lines; 0 otherwise
+        bool trailing;     // With Lines, when more follows the value on its line
+    };
+
+    std::string buffer;        // Input not yet handed out
+    std::deque<Value> ready;   // Complete values
+    size_t scanned = 0;        // Bytes of buffer the scan has seen
+    size_t value_begin = NONE; // Start of the value being scanned
+    size_t value_end = NONE;   // With Lines, where the line's value ended
+    size_t depth = 0;
+    bool in_string = false;
+    bool escaped = false;
+    bool in_atom = false;   // A number or literal at the root, which ends at a delimiter
+    bool skip_line = false; // With Lines, once the rest of the line cannot change the outcome
+    size_t line = 1;        // With Lines, of the byte at scanned
+    size_t taken_line = 0;  // Of the value taken last
+    size_t max_depth;
+    Framing framing;
+    Keys key_mode;
+    std::shared_ptr<KeyTable> keys; // With Shared; documents keep the tables they were parsed into
+
+    void scan();
+    void scan_until(size_t end);
+    void end_line(size_t end);
+    void complete(size_t end);
+    bool take(std::string_view& text, bool& trailing);
+
+public:
+    explicit JSONStream(Framing framing = Values, Keys keys = Separate, size_t max_depth = JSON_MAX_DEPTH)
+        : max_depth(max_depth), framing(framing), key_mode(keys) {}
+
+    // With Values, throws JSONError for nesting past max_depth, and the stream cannot go
+    // on after that. With Lines, only that line fails.
+    void feed(std::string_view chunk);
+    // Ends the input: a trailing number, literal or line is complete, and a value left
+    // open is handed out as it is, for its parse to report
+    void finish();
+
+    // Takes the text of the next complete value; false if there is none yet.
+    // The text stays valid until the next feed(). With Lines, a line with more after
+    // its value is taken and throws JSONError; next_document() and next_events()
+    // parse the value first, so a bad value reports its own error instead.
+    bool next(std::string_view& text);
+    // With Lines, the 1-based line of the value taken last, failed or not; 0 with Values
+    size_t last_line() const { return taken_line; }
+    // Takes and parses the next complete value; nullptr if there is none yet.
+    // A value that fails to parse is still taken, so the stream can go on.
+    JSONDocumentPtr next_document(JSONDocument::Allocation allocation = JSONDocument::Heap,
+                                  JSONDocument::Backend backend = JSONDocument::Character,
+                                  JSONDocument::Strings strings = JSONDocument::Decoded);
+    // Reports the next complete value to handler; false if there is none yet
+    bool next_events(JSONHandler& handler);
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include "json_writer.h"
+#include "number_format.h"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+JSONWriter::JSONWriter(int fd, Style style, size_t flush_threshold)
+    : style(style), fd(fd), flush_threshold(flush_threshold) {
+    buffer.reserve(flush_threshold + 4096);
+}
+
+JSONWriter::~JSONWriter() {
+    if (fd < 0) return;
+    try {
+        flush();
+    } catch (const JSONError&) {
+        // Nothing sensible to do with a write error while unwinding
+    }
+}
+
+void JSONWriter::write(const JSONValue& value) {
+    write_value(value, 0);
+    maybe_flush();
+}
+
+void JSONWriter::write_raw(std::string_view text) {
+    buffer.append(text);
+    maybe_flush();
+}
+
+void JSONWriter::flush() {
+    if (fd < 0) return;
+    size_t written = 0;
+    while (written < buffer.size()) {
+        ssize_t n = ::write(fd, buffer.data() + written, buffer.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw JSONError(std::string("Could not write output: ") + std::strerror(errno));
+        }
+        written += static_cast<size_t>(n);
+    }
+    buffer.clear();
+}
+
+void JSONWriter::newline(size_t depth) {
+    if (style != Pretty) return;
+    buffer += '\n';
+    buffer.append(2 * depth, ' ');
+}
+
+void JSONWriter::write_number(double number) {
+    char digits[MAX_NUMBER_LENGTH];
+    buffer.append(digits, format_json_number(number, digits));
+}
+
+void JSONWriter::write_string(std::string_view text) {
+    static const char HEX[] = "0123456789abcdef";
+    buffer += '"';
+    size_t run = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        // Copy the clean run in one go, then the escape
+        buffer.append(text.data() + run, i - run);
+        run = i + 1;
+        switch (c) {
+            case '"': buffer += "\\\""; break;
+            case '\\': buffer += "\\\\"; break;
+            case '\b': buffer += "\\b"; break;
+            case '\f': buffer += "\\f"; break;
+            case '\n': buffer += "\\n"; break;
+            case '\r': buffer += "\\r"; break;
+            case '\t': buffer += "\\t"; break;
+            default:
+                buffer += "\\u00";
+                buffer += HEX[c >> 4];
+                buffer += HEX[c & 0xF];
+        }
+    }
+    buffer.append(text.data() + run, text.size() - run);
+    buffer += '"';
+}
+
+void JSONWriter::write_value(const JSONValue& value, size_t depth) {
+    if (value.is_null()) {
+        buffer += "null";
+    } else if (value.is_bool()) {
+        buffer += value.as_bool() ? "true" : "false";
+    } else if (value.is_integer()) {
+        char digits[MAX_NUMBER_LENGTH];
+        buffer.append(digits, format_json_integer(value.as_integer(), digits));
+    } else if (value.is_number()) {
+        write_number(value.as_number());
+    } else if (value.is_string()) {
+        write_string(value.as_string());
+    } else if (value.is_number_array()) {
+        const JSONNumberArray& numbers = value.as_number_array();
+        buffer += '[';
+        for (size_t i = 0; i < numbers.size(); ++i) {
+            if (i) buffer += ',';
+            newline(depth + 1);
+            write_number(numbers[i]);
+            maybe_flush();
+        }
+        if (!numbers.empty()) newline(depth);
+        buffer += ']';
+    } else if (value.is_array()) {
+        const JSONArray& items = value.as_array();
+        buffer += '[';
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (i) buffer += ',';
+            newline(depth + 1);
+            write_value(items[i], depth + 1);
+            maybe_flush();
+        }
+        if (!items.empty()) newline(depth);
+        buffer += ']';
+    } else if (value.is_object()) {
+        const JSONObject& object = value.as_object();
+        buffer += '{';
+        bool first = true;
+        for (const auto& member : object) {
+            if (!first) buffer += ',';
+            first = false;
+            newline(depth + 1);
+            write_string(member.first->name);
+            buffer += style == Pretty ? ": " : ":";
+            write_value(member.second, depth + 1);
+            maybe_flush();
+        }
+        if (!object.empty()) newline(depth);
+        buffer += '}';
+    }
+}
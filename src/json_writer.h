@@ -0,0 +1,52 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include "json.h"
+#include <string>
+
+// Serializes values as JSON into one growable buffer, with no temporary
+// strings per node. Writers bound to a file descriptor flush whenever the
+// buffer passes flush_threshold, so memory stays bounded for any result size.
+// A writer can be reused: call clear() (or flush()) between documents.
+class JSONWriter {
+public:
+    enum Style { Compact, Pretty };
+
+private:
+    std::string buffer;
+    Style style;
+    int fd = -1; // -1 keeps everything in the buffer
+    size_t flush_threshold = 1 << 16;
+
+    void write_value(const JSONValue& value, size_t depth);
+    void write_string(std::string_view text);
+    void write_number(double number);
+    void newline(size_t depth);
+    void maybe_flush() { if (fd >= 0 && buffer.size() >= flush_threshold) flush(); }
+
+public:
+    explicit JSONWriter(Style style = Compact) : style(style) {}
+    // Streams to fd, which is not closed by the writer
+    JSONWriter(int fd, Style style, size_t flush_threshold = 1 << 16);
+    ~JSONWriter();
+    JSONWriter(const JSONWriter&) = delete;
+    JSONWriter& operator=(const JSONWriter&) = delete;
+
+    void write(const JSONValue& value);
+    // Appends raw text, such as the newline between documents
+    void write_raw(std::string_view text);
+    // Writes out buffered text; throws JSONError if the descriptor fails
+    void flush();
+
+    // Buffered text; everything written so far when there is no descriptor
+    const std::string& str() const { return buffer; }
+    void clear() { buffer.clear(); }
+    // Hands over the buffered text and leaves the writer empty
+    std::string take() {
+        std::string text = std::move(buffer);
+        buffer.clear();
+        return text;
+    }
+};
+
+#endif
@@ -0,0 +1,190 @@
+#include "key_table.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <mutex>
+
+static std::atomic<uint64_t> next_shape_id{1};
+
+const JSONShape& JSONShape::empty() {
+    static const JSONShape shape{next_shape_id++, 0, nullptr, nullptr, 0, 0, nullptr};
+    return shape;
+}
+
+size_t JSONShape::slot_of(const JSONKey* key) const {
+    if (!slots) {
+        for (size_t i = 0; i < size; ++i) {
+            if (keys[i] == key) return i;
+        }
+        return size;
+    }
+    size_t mask = slot_count - 1;
+    for (size_t slot = key->hash & mask; slots[slot]; slot = (slot + 1) & mask) {
+        if (keys[slots[slot] - 1] == key) return slots[slot] - 1;
+    }
+    return size;
+}
+
+size_t JSONShape::slot_of(std::string_view name) const {
+    if (!slots) {
+        // Lengths rule out most keys before any characters are compared
+        for (size_t i = 0; i < size; ++i) {
+            if (keys[i]->name.size() == name.size() && keys[i]->name == name) return i;
+        }
+        return size;
+    }
+    size_t hash = KeyTable::hash(name);
+    size_t mask = slot_count - 1;
+    for (size_t slot = hash & mask; slots[slot]; slot = (slot + 1) & mask) {
+        const JSONKey* key = keys[slots[slot] - 1];
+        if (key->hash == hash && key->name == name) return slots[slot] - 1;
+    }
+    return size;
+}
+
+KeyTable::KeyTable(bool synchronized) : slots(64, nullptr), shape_slots(64, nullptr), synchronized(synchronized) {}
+
+KeyTable& KeyTable::shared() {
+    static KeyTable* table = new KeyTable(true); // Never destroyed: values may outlive static destructors
+    return *table;
+}
+
+size_t KeyTable::hash(std::string_view name) {
+    return std::hash<std::string_view>()(name);
+}
+
+const JSONKey* KeyTable::lookup(std::string_view name, size_t hash) const {
+    size_t mask = slots.size() - 1;
+    for (size_t slot = hash & mask; slots[slot]; slot = (slot + 1) & mask) {
+        const JSONKey* key = slots[slot];
+        if (key->hash == hash && key->name == name) return key;
+    }
+    return nullptr;
+}
+
+const JSONKey* KeyTable::insert(std::string_view name, size_t hash) {
+    if ((count + 1) * 2 > slots.size()) {
+        // Keep the table at most half full
+        std::vector<const JSONKey*> grown(slots.size() * 2, nullptr);
+        for (const JSONKey* key : slots) {
+            if (!key) continue;
+            size_t slot = key->hash & (grown.size() - 1);
+            while (grown[slot]) slot = (slot + 1) & (grown.size() - 1);
+            grown[slot] = key;
+        }
+        slots.swap(grown);
+    }
+    char* text = static_cast<char*>(storage.allocate(name.size() ? name.size() : 1, 1));
+    if (!name.empty()) std::memcpy(text, name.data(), name.size());
+    JSONKey* key = static_cast<JSONKey*>(storage.allocate(sizeof(JSONKey), alignof(JSONKey)));
+    *key = JSONKey{std::string_view(text, name.size()), hash};
+
+    size_t mask = slots.size() - 1;
+    size_t slot = hash & mask;
+    while (slots[slot]) slot = (slot + 1) & mask;
+    slots[slot] = key;
+    ++count;
+    return key;
+}
+
+const JSONKey* KeyTable::intern(std::string_view name, size_t hash) {
+    if (!synchronized) {
+        if (const JSONKey* key = lookup(name, hash)) return key;
+        return insert(name, hash);
+    }
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if (const JSONKey* key = lookup(name, hash)) return key;
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    if (const JSONKey* key = lookup(name, hash)) return key; // Another thread may have won
+    return insert(name, hash);
+}
+
+const JSONKey* KeyTable::find(std::string_view name, size_t hash) const {
+    if (!synchronized) return lookup(name, hash);
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return lookup(name, hash);
+}
+
+static size_t hash_keys(const JSONKey* const* keys, size_t size) {
+    size_t hash = size;
+    for (size_t i = 0; i < size; ++i) hash = (hash ^ keys[i]->hash) * 0x100000001b3ull;
+    return hash;
+}
+
+const JSONShape* KeyTable::lookup_shape(const JSONKey* const* keys, size_t size, size_t hash) const {
+    size_t mask = shape_slots.size() - 1;
+    for (size_t slot = hash & mask; shape_slots[slot]; slot = (slot + 1) & mask) {
+        const JSONShape* shape = shape_slots[slot];
+        if (shape->hash == hash && shape->size == size && std::equal(keys, keys + size, shape->keys)) return shape;
+    }
+    return nullptr;
+}
+
+const JSONShape* KeyTable::insert_shape(const JSONKey* const* keys, size_t size, size_t hash) {
+    if ((shapes + 1) * 2 > shape_slots.size()) {
+        std::vector<const JSONShape*> grown(shape_slots.size() * 2, nullptr);
+        for (const JSONShape* shape : shape_slots) {
+            if (!shape) continue;
+            size_t slot = shape->hash & (grown.size() - 1);
+            while (grown[slot]) slot = (slot + 1) & (grown.size() - 1);
+            grown[slot] = shape;
+        }
+        shape_slots.swap(grown);
+    }
+
+    const JSONKey** shape_keys = static_cast<const JSONKey**>(storage.allocate(std::max<size_t>(size, 1) * sizeof(JSONKey*), alignof(JSONKey*)));
+    std::copy(keys, keys + size, shape_keys);
+    uint32_t* index = nullptr;
+    size_t capacity = 0;
+    if (size >= JSONShape::HASHED_SIZE) {
+        capacity = 1;
+        while (capacity < size * 2) capacity <<= 1; // At most half full
+        index = static_cast<uint32_t*>(storage.allocate(capacity * sizeof(uint32_t), alignof(uint32_t)));
+        std::fill(index, index + capacity, 0);
+        for (size_t i = 0; i < size; ++i) {
+            size_t slot = keys[i]->hash & (capacity - 1);
+            while (index[slot]) slot = (slot + 1) & (capacity - 1);
+            index[slot] = static_cast<uint32_t>(i + 1);
+        }
+    }
+    JSONShape* shape = static_cast<JSONShape*>(storage.allocate(sizeof(JSONShape), alignof(JSONShape)));
+    *shape = JSONShape{next_shape_id.fetch_add(1, std::memory_order_relaxed), size, shape_keys, index, capacity, hash, this};
+
+    size_t mask = shape_slots.size() - 1;
+    size_t slot = hash & mask;
+    while (shape_slots[slot]) slot = (slot + 1) & mask;
+    shape_slots[slot] = shape;
+    ++shapes;
+    return shape;
+}
+
+const JSONShape* KeyTable::intern_shape(const JSONKey* const* keys, size_t size) {
+    if (size == 0) return &JSONShape::empty();
+    size_t hash = hash_keys(keys, size);
+    if (!synchronized) {
+        if (const JSONShape* shape = lookup_shape(keys, size, hash)) return shape;
+        return insert_shape(keys, size, hash);
+    }
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if (const JSONShape* shape = lookup_shape(keys, size, hash)) return shape;
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    if (const JSONShape* shape = lookup_shape(keys, size, hash)) return shape;
+    return insert_shape(keys, size, hash);
+}
+
+size_t KeyTable::shape_count() const {
+    if (!synchronized) return shapes;
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return shapes;
+}
+
+size_t KeyTable::size() const {
+    if (!synchronized) return count;
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return count;
+}
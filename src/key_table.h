@@ -0,0 +1,82 @@
+#ifndef KEY_TABLE_H
+#define KEY_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+// One distinct object key. Objects hold pointers to these, so two keys from the
+// same table are equal exactly when their pointers are.
+struct JSONKey {
+    std::string_view name;
+    size_t hash;
+};
+
+class KeyTable;
+
+// The key set of an object, shared by every object with the same keys. Keys are
+// sorted by name and an object stores its values in the same order, so a shape
+// maps a key to a value slot. From HASHED_SIZE keys on, the mapping goes through
+// an open-addressing index instead of a scan.
+struct JSONShape {
+    static constexpr size_t HASHED_SIZE = 16;
+
+    uint64_t id;                // Unique for the life of the process, never 0
+    size_t size;
+    const JSONKey* const* keys;
+    const uint32_t* slots;      // Slot + 1, or 0 when free; nullptr for small shapes
+    size_t slot_count;
+    size_t hash;                // Of the key pointers, for finding the shape again
+    KeyTable* table;            // Where the keys and the shape live; nullptr for empty()
+
+    static const JSONShape& empty();
+    // size when missing. The key must come from the table this shape came from.
+    size_t slot_of(const JSONKey* key) const;
+    size_t slot_of(std::string_view name) const;
+};
+
+// Stores each distinct key once, and each distinct key set once as a JSONShape.
+// A table is filled while parsing and only read afterwards. Parsed documents own
+// theirs; a tree from a plain parse owns one through its objects, and copies of
+// objects keep the source's table alive rather than interning anything again.
+// shared() is a synchronized table that lives as long as the process and only grows;
+// it is left for copies out of tables a caller owns, which may go away first.
+class KeyTable : public std::enable_shared_from_this<KeyTable> {
+    std::pmr::monotonic_buffer_resource storage; // Names, keys and shapes; never moved
+    std::vector<const JSONKey*> slots;           // Open addressing; size is a power of two
+    size_t count = 0;
+    std::vector<const JSONShape*> shape_slots;   // Same scheme for shapes
+    size_t shapes = 0;
+    bool synchronized;
+    mutable std::shared_mutex mutex;             // Only taken when synchronized
+
+    const JSONKey* lookup(std::string_view name, size_t hash) const;
+    const JSONKey* insert(std::string_view name, size_t hash);
+    const JSONShape* lookup_shape(const JSONKey* const* keys, size_t size, size_t hash) const;
+    const JSONShape* insert_shape(const JSONKey* const* keys, size_t size, size_t hash);
+
+public:
+    explicit KeyTable(bool synchronized = false);
+    KeyTable(const KeyTable&) = delete;
+    KeyTable& operator=(const KeyTable&) = delete;
+
+    static KeyTable& shared();
+    static size_t hash(std::string_view name);
+
+    const JSONKey* intern(std::string_view name) { return intern(name, hash(name)); }
+    const JSONKey* intern(std::string_view name, size_t hash);
+    // nullptr when the name was never interned, so no object from this table has it
+    const JSONKey* find(std::string_view name) const { return find(name, hash(name)); }
+    const JSONKey* find(std::string_view name, size_t hash) const;
+    size_t size() const;
+
+    // keys must be interned here, sorted by name and free of duplicates
+    const JSONShape* intern_shape(const JSONKey* const* keys, size_t size);
+    size_t shape_count() const;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#include "mapped_file.h"
+#include "json.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw JSONError("Could not open " + path + ": " + std::strerror(errno));
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* memory = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (memory != MAP_FAILED) {
+            mapping = memory;
+            length = static_cast<size_t>(info.st_size);
+            madvise(mapping, length, MADV_SEQUENTIAL); // The parser reads front to back once
+        }
+    }
+
+    try {
+        if (!mapping) read_all(fd);
+    } catch (...) {
+        if (fd != STDIN_FILENO) close(fd);
+        throw;
+    }
+    // A mapping stays valid after its descriptor is closed
+    if (fd != STDIN_FILENO) close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (mapping) munmap(mapping, length);
+}
+
+void MappedFile::read_all(int fd) {
+    char chunk[65536];
+    while (true) {
+        ssize_t n = read(fd, chunk, sizeof chunk);
+        if (n == 0) return;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw JSONError(std::string("Could not read input: ") + std::strerror(errno));
+        }
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+}
+
+std::string_view MappedFile::view() const {
+    if (mapping) return std::string_view(static_cast<const char*>(mapping), length);
+    return buffer;
+}
@@ -0,0 +1,28 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <string_view>
+
+// Read-only view of a file's bytes. Regular files are memory-mapped, so the
+// parser reads straight from the page cache; pipes, terminals and other
+// inputs that cannot be mapped are read into a buffer instead. "-" is stdin.
+class MappedFile {
+    void* mapping = nullptr;
+    size_t length = 0;
+    std::string buffer; // Fallback storage when the input is not mapped
+
+    void read_all(int fd);
+
+public:
+    // Throws JSONError if the file cannot be opened or read
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view view() const;
+    bool is_mapped() const { return mapping != nullptr; }
+};
+
+#endif
@@ -0,0 +1,21 @@
+#include "number_format.h"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+char* format_json_integer(int64_t value, char* out) {
+    return std::to_chars(out, out + MAX_NUMBER_LENGTH, value).ptr;
+}
+
+char* format_json_number(double value, char* out) {
+    if (!std::isfinite(value)) {
+        std::memcpy(out, "null", 4);
+        return out + 4;
+    }
+    // Below 2^53 every integral double is an exact int64; print it as one ("1000000000", not "1e+09")
+    if (value == std::trunc(value) && std::fabs(value) < 9007199254740992.0 && !(value == 0 && std::signbit(value))) {
+        return format_json_integer(static_cast<int64_t>(value), out);
+    }
+    // Shortest round-trip representation (Ryu in libstdc++), independent of the locale
+    return std::to_chars(out, out + MAX_NUMBER_LENGTH, value).ptr;
+}
@@ -0,0 +1,16 @@
+#ifndef NUMBER_FORMAT_H
+#define NUMBER_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Room for the longest number either formatter writes
+const size_t MAX_NUMBER_LENGTH = 32;
+
+// Writes the shortest text that parses back to exactly value and returns the
+// end of the output. Integral values print without a fraction or exponent;
+// NaN and infinities, which JSON cannot represent, print as null.
+char* format_json_number(double value, char* out);
+char* format_json_integer(int64_t value, char* out);
+
+#endif
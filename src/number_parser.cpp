@@ -0,0 +1,136 @@
+#include "number_parser.h"
+#include "json.h"
+#include <charconv>
+#include <cstring>
+
+static const double EXACT_POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+// SWAR: checks and converts eight ASCII digits held in one little-endian word
+static uint64_t load_eight(const char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static bool is_eight_digits(uint64_t v) {
+    return (((v & 0xF0F0F0F0F0F0F0F0ull) | (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) ==
+            0x3333333333333333ull);
+}
+
+static uint32_t parse_eight_digits(uint64_t v) {
+    const uint64_t mask = 0x000000FF000000FFull;
+    const uint64_t mul1 = 0x000F424000000064ull; // 100 + (1000000 << 32)
+    const uint64_t mul2 = 0x0000271000000001ull; // 1 + (10000 << 32)
+    v -= 0x3030303030303030ull;
+    v = (v * 10) + (v >> 8); // Pairs of digits
+    v = (((v & mask) * mul1) + (((v >> 16) & mask) * mul2)) >> 32;
+    return static_cast<uint32_t>(v);
+}
+
+static int decimal_length(uint64_t v) {
+    int n = 0;
+    for (; v; v /= 10) n++;
+    return n;
+}
+
+// Accumulates up to 19 significant digits into mantissa, eight at a time where
+// possible. Dropped integer digits raise the exponent; kept fraction digits
+// (including leading zeros) lower it. significant > 19 means digits were dropped.
+static const char* read_digits(const char* p, const char* end, bool fraction,
+                               uint64_t& mantissa, int& significant, int64_t& exponent) {
+    while (significant + 8 <= 19 && end - p >= 8 && is_eight_digits(load_eight(p))) {
+        bool leading = mantissa == 0;
+        mantissa = mantissa * 100000000 + parse_eight_digits(load_eight(p));
+        significant += leading ? decimal_length(mantissa) : 8;
+        if (fraction) exponent -= 8;
+        p += 8;
+    }
+    for (; p != end && is_digit(*p); ++p) {
+        if (significant < 19) {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+            if (mantissa != 0) significant++;
+            if (fraction) exponent--;
+        } else {
+            significant++;
+            if (!fraction) exponent++;
+        }
+    }
+    return p;
+}
+
+const char* parse_json_number(const char* begin, const char* end, ParsedNumber& out) {
+    const char* p = begin;
+    bool negative = p != end && *p == '-';
+    if (negative) ++p;
+
+    uint64_t mantissa = 0;
+    int significant = 0;
+    int64_t exponent = 0;
+    bool is_integer = true;
+
+    if (p != end && *p == '0') {
+        ++p;
+    } else if (p != end && is_digit(*p)) {
+        p = read_digits(p, end, false, mantissa, significant, exponent);
+    } else {
+        throw JSONError("Invalid JSON number");
+    }
+    if (p != end && *p == '.') {
+        ++p;
+        if (p == end || !is_digit(*p)) throw JSONError("Invalid JSON number");
+        p = read_digits(p, end, true, mantissa, significant, exponent);
+        is_integer = false;
+    }
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool negative_exponent = p != end && *p == '-';
+        if (p != end && (*p == '+' || *p == '-')) ++p;
+        if (p == end || !is_digit(*p)) throw JSONError("Invalid JSON number");
+        int64_t value = 0;
+        for (; p != end && is_digit(*p); ++p) {
+            if (value < 100000) value = value * 10 + (*p - '0'); // Saturates far beyond any double
+        }
+        exponent += negative_exponent ? -value : value;
+        is_integer = false;
+    }
+
+    out = ParsedNumber();
+    bool truncated = significant > 19;
+    if (is_integer && !truncated && !(negative && mantissa == 0)) {
+        uint64_t limit = negative ? uint64_t(1) << 63 : (uint64_t(1) << 63) - 1;
+        if (mantissa <= limit) {
+            out.is_integer = true;
+            out.integer = negative ? static_cast<int64_t>(0 - mantissa) : static_cast<int64_t>(mantissa);
+            out.number = static_cast<double>(out.integer);
+            return p;
+        }
+    }
+
+    // Clinger's fast path: mantissa and power of ten are both exact doubles,
+    // so a single correctly rounded multiply or divide gives the exact result
+    if (!truncated && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+        double value = static_cast<double>(mantissa);
+        if (exponent < 0) value /= EXACT_POWERS_OF_TEN[-exponent];
+        else value *= EXACT_POWERS_OF_TEN[exponent];
+        out.number = negative ? -value : value;
+        return p;
+    }
+
+    // Everything else goes to std::from_chars, which is exact and ignores the locale
+    double value = 0;
+    auto result = std::from_chars(begin, p, value);
+    if (result.ec == std::errc::result_out_of_range) {
+        // Tiny magnitudes round to zero; huge ones cannot be represented
+        if (exponent + significant > 0) throw JSONError("Number out of range");
+        value = negative ? -0.0 : 0.0;
+    } else if (result.ec != std::errc() || result.ptr != p) {
+        throw JSONError("Invalid JSON number");
+    }
+    out.number = value;
+    return p;
+}
@@ -0,0 +1,23 @@
+#ifndef NUMBER_PARSER_H
+#define NUMBER_PARSER_H
+
+#include <cstdint>
+
+// A JSON number as written. Integers without a fraction or exponent that fit
+// in int64 are kept exact; everything else is the nearest double.
+struct ParsedNumber {
+    bool is_integer = false;
+    int64_t integer = 0;
+    double number = 0;
+};
+
+// Whether storing the number as a double, as packed arrays do, loses nothing
+inline bool is_exact_double(const ParsedNumber& n) {
+    return !n.is_integer || (n.integer >= -(int64_t(1) << 53) && n.integer <= (int64_t(1) << 53));
+}
+
+// Parses the JSON number at the start of [begin, end) and returns the position
+// after it. Throws JSONError on invalid grammar or if the value overflows a double.
+const char* parse_json_number(const char* begin, const char* end, ParsedNumber& out);
+
+#endif
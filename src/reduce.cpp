@@ -0,0 +1,166 @@
+#include "reduce.h"
+#include <algorithm>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define JSON_EVAL_X86 1
+#include <immintrin.h>
+#endif
+
+static const double INF = std::numeric_limits<double>::infinity();
+
+static double sum_scalar(const double* v, size_t n) {
+    double s = 0.0;
+    for (size_t i = 0; i < n; ++i) s += v[i];
+    return s;
+}
+
+static double min_scalar(const double* v, size_t n, double acc = INF) {
+    for (size_t i = 0; i < n; ++i) acc = std::min(acc, v[i]);
+    return acc;
+}
+
+static double max_scalar(const double* v, size_t n, double acc = -INF) {
+    for (size_t i = 0; i < n; ++i) acc = std::max(acc, v[i]);
+    return acc;
+}
+
+#ifdef JSON_EVAL_X86
+
+// min_pd(x, acc) is (x < acc) ? x : acc, which matches std::min(acc, x)
+
+__attribute__((target("sse2")))
+static double sum_sse2(const double* v, size_t n) {
+    __m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd(), a2 = _mm_setzero_pd(), a3 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        a0 = _mm_add_pd(a0, _mm_loadu_pd(v + i));
+        a1 = _mm_add_pd(a1, _mm_loadu_pd(v + i + 2));
+        a2 = _mm_add_pd(a2, _mm_loadu_pd(v + i + 4));
+        a3 = _mm_add_pd(a3, _mm_loadu_pd(v + i + 6));
+    }
+    __m128d acc = _mm_add_pd(_mm_add_pd(a0, a1), _mm_add_pd(a2, a3));
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    return lanes[0] + lanes[1] + sum_scalar(v + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static double min_sse2(const double* v, size_t n) {
+    __m128d a0 = _mm_set1_pd(INF), a1 = _mm_set1_pd(INF);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        a0 = _mm_min_pd(_mm_loadu_pd(v + i), a0);
+        a1 = _mm_min_pd(_mm_loadu_pd(v + i + 2), a1);
+    }
+    double lanes[4];
+    _mm_storeu_pd(lanes, a0);
+    _mm_storeu_pd(lanes + 2, a1);
+    return min_scalar(v + i, n - i, min_scalar(lanes, 4));
+}
+
+__attribute__((target("sse2")))
+static double max_sse2(const double* v, size_t n) {
+    __m128d a0 = _mm_set1_pd(-INF), a1 = _mm_set1_pd(-INF);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        a0 = _mm_max_pd(_mm_loadu_pd(v + i), a0);
+        a1 = _mm_max_pd(_mm_loadu_pd(v + i + 2), a1);
+    }
+    double lanes[4];
+    _mm_storeu_pd(lanes, a0);
+    _mm_storeu_pd(lanes + 2, a1);
+    return max_scalar(v + i, n - i, max_scalar(lanes, 4));
+}
+
+__attribute__((target("avx2")))
+static double sum_avx2(const double* v, size_t n) {
+    __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd(), a2 = _mm256_setzero_pd(), a3 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        a0 = _mm256_add_pd(a0, _mm256_loadu_pd(v + i));
+        a1 = _mm256_add_pd(a1, _mm256_loadu_pd(v + i + 4));
+        a2 = _mm256_add_pd(a2, _mm256_loadu_pd(v + i + 8));
+        a3 = _mm256_add_pd(a3, _mm256_loadu_pd(v + i + 12));
+    }
+    __m256d acc = _mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3));
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + sum_scalar(v + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static double min_avx2(const double* v, size_t n) {
+    __m256d a0 = _mm256_set1_pd(INF), a1 = _mm256_set1_pd(INF);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        a0 = _mm256_min_pd(_mm256_loadu_pd(v + i), a0);
+        a1 = _mm256_min_pd(_mm256_loadu_pd(v + i + 4), a1);
+    }
+    double lanes[8];
+    _mm256_storeu_pd(lanes, a0);
+    _mm256_storeu_pd(lanes + 4, a1);
+    return min_scalar(v + i, n - i, min_scalar(lanes, 8));
+}
+
+__attribute__((target("avx2")))
+static double max_avx2(const double* v, size_t n) {
+    __m256d a0 = _mm256_set1_pd(-INF), a1 = _mm256_set1_pd(-INF);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        a0 = _mm256_max_pd(_mm256_loadu_pd(v + i), a0);
+        a1 = _mm256_max_pd(_mm256_loadu_pd(v + i + 4), a1);
+    }
+    double lanes[8];
+    _mm256_storeu_pd(lanes, a0);
+    _mm256_storeu_pd(lanes + 4, a1);
+    return max_scalar(v + i, n - i, max_scalar(lanes, 8));
+}
+
+#endif
+
+SimdLevel detected_simd_level() {
+#ifdef JSON_EVAL_X86
+    static const SimdLevel level = __builtin_cpu_supports("avx2") ? SimdLevel::AVX2
+                                 : __builtin_cpu_supports("sse2") ? SimdLevel::SSE2
+                                 : SimdLevel::Scalar;
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+double reduce_sum(const double* values, size_t count, SimdLevel level) {
+#ifdef JSON_EVAL_X86
+    if (level == SimdLevel::AVX2) return sum_avx2(values, count);
+    if (level == SimdLevel::SSE2) return sum_sse2(values, count);
+#endif
+    (void)level;
+    return sum_scalar(values, count);
+}
+
+double reduce_min(const double* values, size_t count, SimdLevel level) {
+#ifdef JSON_EVAL_X86
+    if (level == SimdLevel::AVX2) return min_avx2(values, count);
+    if (level == SimdLevel::SSE2) return min_sse2(values, count);
+#endif
+    (void)level;
+    return min_scalar(values, count);
+}
+
+double reduce_max(const double* values, size_t count, SimdLevel level) {
+#ifdef JSON_EVAL_X86
+    if (level == SimdLevel::AVX2) return max_avx2(values, count);
+    if (level == SimdLevel::SSE2) return max_sse2(values, count);
+#endif
+    (void)level;
+    return max_scalar(values, count);
+}
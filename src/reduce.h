@@ -0,0 +1,18 @@
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#include <cstddef>
+
+// Vectorized reductions over contiguous doubles, used by sum/min/max/avg.
+// The widest instruction set the CPU supports is picked at runtime.
+enum class SimdLevel { Scalar, SSE2, AVX2 };
+
+SimdLevel detected_simd_level();
+const char* simd_level_name(SimdLevel level);
+
+double reduce_sum(const double* values, size_t count, SimdLevel level = detected_simd_level());
+// Same comparison as folding std::min/std::max from +inf/-inf, so empty input yields +inf/-inf
+double reduce_min(const double* values, size_t count, SimdLevel level = detected_simd_level());
+double reduce_max(const double* values, size_t count, SimdLevel level = detected_simd_level());
+
+#endif
@@ -0,0 +1,227 @@
+#include "string_parser.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define JSON_EVAL_X86 1
+#include <immintrin.h>
+#endif
+
+// Bytes that can be copied verbatim: printable ASCII other than '"' and '\\'
+static const char* skip_clean_scalar(const char* p, const char* end) {
+    for (; p != end; ++p) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c < 0x20 || c >= 0x80 || c == '"' || c == '\\') break;
+    }
+    return p;
+}
+
+#ifdef JSON_EVAL_X86
+
+// A signed compare against 0x20 also catches bytes >= 0x80, which need UTF-8 checks
+
+__attribute__((target("sse2")))
+static const char* skip_clean_sse2(const char* p, const char* end) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(0x20);
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                                       _mm_cmplt_epi8(v, space));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(special));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return skip_clean_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* skip_clean_avx2(const char* p, const char* end) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i space = _mm256_set1_epi8(0x20);
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i special = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)),
+                                          _mm256_cmpgt_epi8(space, v));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(special));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return skip_clean_sse2(p, end);
+}
+
+#endif
+
+static const char* skip_clean(const char* p, const char* end, SimdLevel level) {
+#ifdef JSON_EVAL_X86
+    if (level == SimdLevel::AVX2) return skip_clean_avx2(p, end);
+    if (level == SimdLevel::SSE2) return skip_clean_sse2(p, end);
+#endif
+    (void)level;
+    return skip_clean_scalar(p, end);
+}
+
+// Checks one multi-byte UTF-8 sequence starting at p and returns its end
+static const char* validate_utf8(const char* p, const char* end) {
+    auto byte = [&](ptrdiff_t i) { return p + i < end ? static_cast<unsigned char>(p[i]) : 0; };
+    auto continuation = [&](ptrdiff_t i, unsigned char lo = 0x80, unsigned char hi = 0xBF) {
+        unsigned char c = byte(i);
+        return c >= lo && c <= hi;
+    };
+    unsigned char lead = byte(0);
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        if (continuation(1)) return p + 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        // No overlong forms (E0) and no UTF-16 surrogates (ED)
+        unsigned char lo = lead == 0xE0 ? 0xA0 : 0x80;
+        unsigned char hi = lead == 0xED ? 0x9F : 0xBF;
+        if (continuation(1, lo, hi) && continuation(2)) return p + 3;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        // Nothing overlong (F0) or above U+10FFFF (F4)
+        unsigned char lo = lead == 0xF0 ? 0x90 : 0x80;
+        unsigned char hi = lead == 0xF4 ? 0x8F : 0xBF;
+        if (continuation(1, lo, hi) && continuation(2) && continuation(3)) return p + 4;
+    }
+    throw JSONError("Invalid UTF-8 in string");
+}
+
+static unsigned read_hex4(const char* p, const char* end) {
+    if (end - p < 4) throw JSONError("Invalid unicode escape");
+    unsigned value = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') value |= static_cast<unsigned>(c - '0');
+        else if (c >= 'a' && c <= 'f') value |= static_cast<unsigned>(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') value |= static_cast<unsigned>(c - 'A' + 10);
+        else throw JSONError("Invalid unicode escape");
+    }
+    return value;
+}
+
+// Where decoded text goes: a string, the input itself, or nowhere when only validating
+struct AppendSink {
+    JSONString& out;
+    void append(const char* p, size_t n) { out.append(p, n); }
+    void put(char c) { out += c; }
+};
+
+struct InPlaceSink {
+    char* dest; // Never ahead of the read position, since decoding only shrinks text
+    void append(const char* p, size_t n) {
+        if (dest != p) std::memmove(dest, p, n);
+        dest += n;
+    }
+    void put(char c) { *dest++ = c; }
+};
+
+struct ValidateSink {
+    bool escaped = false;
+    void append(const char*, size_t) {}
+    void put(char) { escaped = true; }
+};
+
+template <class Sink>
+static void append_utf8(unsigned code_point, Sink& out) {
+    if (code_point < 0x80) {
+        out.put(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+        out.put(static_cast<char>(0xC0 | (code_point >> 6)));
+        out.put(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+        out.put(static_cast<char>(0xE0 | (code_point >> 12)));
+        out.put(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        out.put(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else {
+        out.put(static_cast<char>(0xF0 | (code_point >> 18)));
+        out.put(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+        out.put(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        out.put(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+}
+
+// Decodes the escape after a backslash at p and returns the position after it
+template <class Sink>
+static const char* decode_escape(const char* p, const char* end, Sink& out) {
+    char escaped = p + 1 < end ? p[1] : '\0';
+    switch (escaped) {
+        case '"': out.put('"'); return p + 2;
+        case '\\': out.put('\\'); return p + 2;
+        case '/': out.put('/'); return p + 2;
+        case 'b': out.put('\b'); return p + 2;
+        case 'f': out.put('\f'); return p + 2;
+        case 'n': out.put('\n'); return p + 2;
+        case 'r': out.put('\r'); return p + 2;
+        case 't': out.put('\t'); return p + 2;
+        case 'u': break;
+        default: throw JSONError("Invalid escape character");
+    }
+
+    unsigned code_point = read_hex4(p + 2, end);
+    p += 6;
+    if (code_point >= 0xDC00 && code_point <= 0xDFFF) throw JSONError("Invalid unicode escape");
+    if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+        // A high surrogate must be followed by an escaped low surrogate
+        if (end - p < 2 || p[0] != '\\' || p[1] != 'u') throw JSONError("Invalid unicode escape");
+        unsigned low = read_hex4(p + 2, end);
+        if (low < 0xDC00 || low > 0xDFFF) throw JSONError("Invalid unicode escape");
+        code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+        p += 6;
+    }
+    append_utf8(code_point, out);
+    return p;
+}
+
+template <class Sink>
+static const char* decode(const char* begin, const char* end, Sink& out, SimdLevel level) {
+    const char* p = begin;
+    while (true) {
+        const char* run = p;
+        p = skip_clean(p, end, level);
+        out.append(run, static_cast<size_t>(p - run));
+        if (p == end) throw JSONError("Unterminated string");
+
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c == '"') return p + 1;
+        if (c == '\\') {
+            p = decode_escape(p, end, out);
+        } else if (c >= 0x80) {
+            const char* next = validate_utf8(p, end);
+            out.append(p, static_cast<size_t>(next - p));
+            p = next;
+        } else {
+            throw JSONError("Invalid control character in string");
+        }
+    }
+}
+
+const char* parse_json_string(const char* begin, const char* end, JSONString& out, SimdLevel level) {
+    AppendSink sink{out};
+    return decode(begin, end, sink, level);
+}
+
+const char* scan_json_string(const char* begin, const char* end, bool& escaped, SimdLevel level) {
+    ValidateSink sink;
+    const char* next = decode(begin, end, sink, level);
+    escaped = sink.escaped;
+    return next;
+}
+
+const char* parse_json_key(const char* begin, const char* end, KeyTable& keys, const JSONKey*& key,
+                           JSONString& scratch) {
+    bool escaped;
+    const char* next = scan_json_string(begin, end, escaped);
+    if (!escaped) {
+        key = keys.intern(std::string_view(begin, static_cast<size_t>(next - begin) - 1));
+        return next;
+    }
+    scratch.clear();
+    parse_json_string(begin, end, scratch);
+    key = keys.intern(scratch);
+    return next;
+}
+
+size_t decode_json_string_in_place(char* begin, const char* end) {
+    InPlaceSink sink{begin};
+    decode(begin, end, sink, detected_simd_level());
+    return static_cast<size_t>(sink.dest - begin);
+}
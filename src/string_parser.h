@@ -0,0 +1,31 @@
+#ifndef STRING_PARSER_H
+#define STRING_PARSER_H
+
+#include "json.h"
+#include "reduce.h"
+
+// Decodes the JSON string whose opening quote has already been consumed:
+// begin points at its first character. Appends the text to out and returns
+// the position just past the closing quote. Escapes, including \uXXXX
+// surrogate pairs, are decoded and raw bytes are validated as UTF-8 on the
+// way; throws JSONError on anything malformed. Clean ASCII runs are found with
+// SIMD and appended in bulk.
+const char* parse_json_string(const char* begin, const char* end, JSONString& out,
+                              SimdLevel level = detected_simd_level());
+
+// Validates the same way without decoding, for strings kept as raw slices.
+// Sets escaped when decoding would change the text.
+const char* scan_json_string(const char* begin, const char* end, bool& escaped,
+                             SimdLevel level = detected_simd_level());
+
+// Reads an object key the same way and interns it. Keys without escapes are
+// interned straight from the input; the others are decoded into scratch first.
+const char* parse_json_key(const char* begin, const char* end, KeyTable& keys, const JSONKey*& key,
+                           JSONString& scratch);
+
+// Decodes an already validated string over its own bytes, which is possible
+// because no escape decodes to more bytes than it takes. end must be past the
+// closing quote. Returns the decoded length.
+size_t decode_json_string_in_place(char* begin, const char* end);
+
+#endif
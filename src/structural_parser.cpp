@@ -0,0 +1,291 @@
+#include "structural_parser.h"
+#include "string_parser.h"
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define JSON_EVAL_X86 1
+#include <immintrin.h>
+#endif
+
+// One bit per byte of a 64-byte block
+struct BlockMasks {
+    uint64_t quote = 0;
+    uint64_t backslash = 0;
+    uint64_t op = 0;    // { } [ ] : ,
+    uint64_t space = 0; // JSON whitespace
+};
+
+static void classify_scalar(const char* block, BlockMasks& masks) {
+    for (int i = 0; i < 64; ++i) {
+        uint64_t bit = uint64_t(1) << i;
+        switch (block[i]) {
+            case '"': masks.quote |= bit; break;
+            case '\\': masks.backslash |= bit; break;
+            case '{': case '}': case '[': case ']': case ':': case ',': masks.op |= bit; break;
+            case ' ': case '\t': case '\n': case '\r': masks.space |= bit; break;
+            default: break;
+        }
+    }
+}
+
+#ifdef JSON_EVAL_X86
+
+// '[' and ']' differ from '{' and '}' only in bit 0x20, so two compares cover all four brackets
+
+__attribute__((target("sse2")))
+static uint64_t movemask_sse2(__m128i eq) {
+    return static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(eq)));
+}
+
+__attribute__((target("sse2")))
+static void classify_sse2(const char* block, BlockMasks& masks) {
+    for (int i = 0; i < 4; ++i) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+        __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        int shift = 16 * i;
+        masks.quote |= movemask_sse2(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << shift;
+        masks.backslash |= movemask_sse2(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << shift;
+        masks.op |= movemask_sse2(_mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')), _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')), _mm_cmpeq_epi8(v, _mm_set1_epi8(','))))) << shift;
+        masks.space |= movemask_sse2(_mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))))) << shift;
+    }
+}
+
+__attribute__((target("avx2")))
+static uint64_t movemask_avx2(__m256i eq) {
+    return static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(eq)));
+}
+
+__attribute__((target("avx2")))
+static void classify_avx2(const char* block, BlockMasks& masks) {
+    for (int i = 0; i < 2; ++i) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32 * i));
+        __m256i folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        int shift = 32 * i;
+        masks.quote |= movemask_avx2(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << shift;
+        masks.backslash |= movemask_avx2(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))) << shift;
+        masks.op |= movemask_avx2(_mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))))) << shift;
+        masks.space |= movemask_avx2(_mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))))) << shift;
+    }
+}
+
+#endif
+
+static BlockMasks classify(const char* block, SimdLevel level) {
+    BlockMasks masks;
+#ifdef JSON_EVAL_X86
+    if (level == SimdLevel::AVX2) { classify_avx2(block, masks); return masks; }
+    if (level == SimdLevel::SSE2) { classify_sse2(block, masks); return masks; }
+#endif
+    (void)level;
+    classify_scalar(block, masks);
+    return masks;
+}
+
+// Bits of characters preceded by an odd-length run of backslashes. prev_escaped
+// carries whether the first byte of the next block is escaped.
+static uint64_t find_escaped(uint64_t backslash, uint64_t& prev_escaped) {
+    backslash &= ~prev_escaped;
+    uint64_t follows_escape = backslash << 1 | prev_escaped;
+    const uint64_t even_bits = 0x5555555555555555ull;
+    uint64_t odd_sequence_starts = backslash & ~even_bits & ~follows_escape;
+    uint64_t sequences_starting_on_even_bits;
+    prev_escaped = __builtin_add_overflow(odd_sequence_starts, backslash, &sequences_starting_on_even_bits);
+    uint64_t invert_mask = sequences_starting_on_even_bits << 1;
+    return (even_bits ^ invert_mask) & follows_escape;
+}
+
+// Bit i becomes the xor of bits 0..i: set from an opening quote up to (not including) its closing quote
+static uint64_t prefix_xor(uint64_t bits) {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+std::vector<uint32_t> StructuralParser::index(std::string_view text, SimdLevel level) {
+    if (text.size() >= std::numeric_limits<uint32_t>::max()) throw JSONError("Document too large for the structural parser");
+
+    std::vector<uint32_t> positions;
+    positions.reserve(text.size() / 16 + 1); // Grows from there on dense input, instead of holding input-sized memory up front
+    uint64_t prev_escaped = 0;
+    uint64_t prev_in_string = 0; // All ones while a string continues into the next block
+    uint64_t prev_scalar = 0;
+
+    for (size_t base = 0; base < text.size(); base += 64) {
+        const char* block = text.data() + base;
+        char tail[64];
+        if (text.size() - base < 64) {
+            // Pad the last block with whitespace, which is never indexed
+            std::memset(tail, ' ', sizeof tail);
+            std::memcpy(tail, block, text.size() - base);
+            block = tail;
+        }
+        BlockMasks masks = classify(block, level);
+
+        uint64_t quotes = masks.quote & ~find_escaped(masks.backslash, prev_escaped);
+        uint64_t in_string = prefix_xor(quotes) ^ prev_in_string;
+        prev_in_string = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+
+        // Numbers and literals are indexed by their first byte
+        uint64_t scalar = ~(masks.op | masks.space | quotes) & ~in_string;
+        uint64_t scalar_starts = scalar & ~(scalar << 1 | prev_scalar);
+        prev_scalar = scalar >> 63;
+
+        // Opening quotes are the quotes inside the string mask
+        uint64_t bits = (masks.op & ~in_string) | (quotes & in_string) | scalar_starts;
+        size_t at = positions.size();
+        positions.resize(at + static_cast<size_t>(__builtin_popcountll(bits)));
+        for (; bits; bits &= bits - 1) positions[at++] = static_cast<uint32_t>(base + __builtin_ctzll(bits));
+    }
+    if (prev_in_string) throw JSONError("Unterminated string");
+
+    positions.push_back(static_cast<uint32_t>(text.size()));
+    return positions;
+}
+
+// Stage 2: the same descent as JSON, over the index instead of the bytes
+class TreeBuilder {
+    std::string_view text;
+    const std::vector<uint32_t>& positions;
+    size_t next = 0;
+    std::pmr::memory_resource* resource;
+    bool lazy_strings;
+    std::shared_ptr<KeyTable> own_keys; // When the caller gave no table
+    KeyTable* keys;
+    size_t max_depth;
+    JSONBuilder builder;
+    JSONString string_buffer;
+
+    size_t advance() {
+        if (next >= positions.size()) throw JSONError("Unexpected end of input");
+        return positions[next++];
+    }
+    char at(size_t pos) const { return pos < text.size() ? text[pos] : '\0'; }
+
+    // A number or literal runs until the next indexed position, minus trailing whitespace
+    std::string_view atom(size_t pos) const {
+        size_t end = next < positions.size() ? positions[next] : text.size();
+        while (end > pos && is_json_space(text[end - 1])) --end;
+        return text.substr(pos, end - pos);
+    }
+
+    std::string_view read_string(size_t pos) {
+        string_buffer.clear();
+        parse_json_string(text.data() + pos + 1, text.data() + text.size(), string_buffer);
+        return string_buffer;
+    }
+
+    const JSONKey* read_key(size_t pos) {
+        const JSONKey* key;
+        parse_json_key(text.data() + pos + 1, text.data() + text.size(), *keys, key, string_buffer);
+        return key;
+    }
+
+    JSONValue string_value(size_t pos) {
+        if (!lazy_strings) return JSONValue(read_string(pos), resource);
+        char* begin = const_cast<char*>(text.data()) + pos + 1; // Writable, as for JSON
+        bool escaped;
+        const char* end = scan_json_string(begin, text.data() + text.size(), escaped);
+        return JSONValue(JSONRawString{begin, static_cast<size_t>(end - begin) - 1, escaped});
+    }
+
+    ParsedNumber read_number(size_t pos) const {
+        std::string_view digits = atom(pos);
+        ParsedNumber number;
+        if (parse_json_number(digits.data(), digits.data() + digits.size(), number) != digits.data() + digits.size()) {
+            throw JSONError("Invalid JSON number");
+        }
+        return number;
+    }
+
+    // Reads a key and its ':' from pos and returns the position of the member's value
+    size_t read_member_key(size_t pos) {
+        if (at(pos) != '"') throw JSONError("Expected string key");
+        builder.key(read_key(pos));
+        if (at(advance()) != ':') throw JSONError("Expected ':'");
+        return advance();
+    }
+
+    JSONValue scalar_value(size_t pos) {
+        char c = at(pos);
+        if (c == '"') return string_value(pos);
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            ParsedNumber number = read_number(pos);
+            if (number.is_integer) return JSONValue(number.integer);
+            return JSONValue(number.number);
+        }
+        std::string_view word = atom(pos);
+        if (word == "true") return JSONValue(true);
+        if (word == "false") return JSONValue(false);
+        if (word == "null") return JSONValue(nullptr);
+        if (c == 't' || c == 'f') throw JSONError("Invalid JSON boolean");
+        if (c == 'n') throw JSONError("Invalid JSON null");
+        throw JSONError("Invalid JSON value");
+    }
+
+public:
+    TreeBuilder(std::string_view text, const std::vector<uint32_t>& positions, std::pmr::memory_resource* resource,
+                bool lazy_strings, KeyTable* keys, size_t max_depth)
+        : text(text), positions(positions), resource(resource), lazy_strings(lazy_strings),
+          own_keys(keys ? nullptr : std::make_shared<KeyTable>()), keys(keys ? keys : own_keys.get()),
+          max_depth(max_depth), builder(resource, this->keys, own_keys) {}
+
+    // One loop, like JSON's, with open containers on the builder's stack
+    JSONValue parse_root() {
+        size_t pos = advance();
+        while (true) {
+            char c = at(pos);
+            if (c == '[' || c == '{') {
+                if (builder.depth() >= max_depth) throw JSONError("Maximum nesting depth exceeded");
+                builder.start(c == '{');
+                pos = advance();
+                if (at(pos) != (c == '{' ? '}' : ']')) {
+                    if (c == '{') pos = read_member_key(pos);
+                    continue;
+                }
+                builder.end();
+            } else if (builder.packed() && (c == '-' || (c >= '0' && c <= '9'))) {
+                ParsedNumber number = read_number(pos);
+                if (is_exact_double(number)) builder.add_number(number.number);
+                else builder.add(JSONValue(number.integer));
+            } else {
+                builder.add(scalar_value(pos));
+            }
+
+            while (true) {
+                if (builder.depth() == 0) {
+                    if (next + 1 != positions.size()) throw JSONError("Unexpected content after JSON value");
+                    return builder.take();
+                }
+                bool object = builder.in_object();
+                c = at(advance());
+                if (c == ',') {
+                    pos = advance();
+                    if (object) pos = read_member_key(pos);
+                    break;
+                }
+                if (c != (object ? '}' : ']')) throw JSONError(object ? "Expected ',' or '}'" : "Expected ',' or ']'");
+                builder.end();
+            }
+        }
+    }
+};
+
+JSONValue StructuralParser::parse(std::string_view text, std::pmr::memory_resource* resource, bool lazy_strings,
+                                  KeyTable* keys, size_t max_depth) {
+    std::vector<uint32_t> positions = index(text);
+    TreeBuilder builder(text, positions, resource, lazy_strings, keys, max_depth);
+    return builder.parse_root();
+}
@@ -0,0 +1,26 @@
+#ifndef STRUCTURAL_PARSER_H
+#define STRUCTURAL_PARSER_H
+
+#include "json.h"
+#include "reduce.h"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Two-stage parser producing the same tree as JSON. Stage 1 classifies the
+// input 64 bytes at a time with SIMD and records the offset of every
+// structural character ({ } [ ] : ,), every opening quote and the first byte
+// of every number or literal. Stage 2 builds the tree by walking that index,
+// so whitespace is never visited one byte at a time.
+// Unlike JSON, anything after the root value other than whitespace is an error.
+class StructuralParser {
+public:
+    // lazy_strings, keys and max_depth as for JSON
+    static JSONValue parse(std::string_view text, std::pmr::memory_resource* resource = std::pmr::get_default_resource(),
+                           bool lazy_strings = false, KeyTable* keys = nullptr, size_t max_depth = JSON_MAX_DEPTH);
+
+    // Stage 1 on its own. The last entry is text.size(), marking the end.
+    static std::vector<uint32_t> index(std::string_view text, SimdLevel level = detected_simd_level());
+};
+
+#endif
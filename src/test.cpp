@@ -2,6 +2,24 @@
 #include "catch.hpp"
 #include "json.h" // Include your JSON class
 #include "evaluator.h" // Include your Evaluator class
+#include "json_stream.h"
+#include "json_writer.h"
+#include "key_table.h"
+#include "mapped_file.h"
+#include "number_format.h"
+#include "number_parser.h"
+#include "reduce.h"
+#include "string_parser.h"
+#include "structural_parser.h"
+#include "thread_pool.h"
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <charconv>
+#include <random>
+#include <cstring>
 
 // Parsing the updated JSON structure
 JSONValue json = JSON::parse(R"({
@@ -36,9 +54,1172 @@ TEST_CASE("Arithmetic Operations") {
 TEST_CASE("Complex Expressions") {
     REQUIRE(evaluator.evaluate("a.b[5][1] % a.b[4]").as_number() == 1); // 10 % 3
     REQUIRE(evaluator.evaluate("a.b[2] * a.b[3] + a.b[4]").as_number() == 5); // 1 * (2 + 3)
+
+    // '%' works on the truncated operands at any magnitude, never trapping on int overflow
+    Evaluator big(JSON::parse(R"({"n": 123456789012, "m": -2147483648})"));
+    for (auto [expr, expected] : std::vector<std::pair<const char*, double>>{
+             {"3000000000 % -1", 0}, {"-2147483648 % -1", 0}, {"n % -1", 0}, {"m % -1", 0}, {"n % 1000", 12},
+             {"n % 7", 123456789012 % 7}, {"-7 % 2", -1}, {"7.9 % 2.5", 1}, {"1e20 % 3", 1}}) {
+        CompiledExpression compiled = CompiledExpression::compile(expr);
+        INFO(expr);
+        REQUIRE(big.evaluate(compiled).as_number() == expected);
+        REQUIRE(big.evaluate_tree(compiled).as_number() == expected);
+    }
+    REQUIRE_THROWS_WITH(big.evaluate("n % 0.5"), "Division by zero");
 }
 
 TEST_CASE("Logical Operations") {
     REQUIRE(evaluator.evaluate("a.b[0] && a.b[2]").as_bool() == false); // 0 && 1 -> false
     REQUIRE(evaluator.evaluate("a.b[2] || a.b[1]").as_bool() == true); // 1 || 0 -> true
 }
+
+TEST_CASE("Path Arguments Are Borrowed From The Document") {
+    REQUIRE(evaluator.evaluate("sum(a.b[5])").as_number() == 30); // 0 + 10 + 20
+    REQUIRE(evaluator.evaluate("size(a.b)").as_number() == 7);
+    REQUIRE(evaluator.evaluate("a.b[5]").as_array().size() == 3); // Final value is materialized
+    REQUIRE(json.as_object().at("a").as_object().at("b").as_array().size() == 7); // Document is untouched
+}
+
+TEST_CASE("Evaluators Share One Document") {
+    JSONDocumentPtr document = JSONDocument::parse(R"({"x": [1, 2, 3]})");
+    std::vector<Evaluator> evaluators(4, Evaluator(document));
+    for (const auto& e : evaluators) {
+        REQUIRE(&e.get_document()->root() == &document->root()); // No copy of the tree
+    }
+
+    std::vector<double> results(evaluators.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < evaluators.size(); ++i) {
+        threads.emplace_back([&, i] { results[i] = evaluators[i].evaluate("sum(x)").as_number(); });
+    }
+    for (auto& t : threads) t.join();
+    for (double r : results) REQUIRE(r == 6);
+}
+
+TEST_CASE("Operator Precedence And Literals") {
+    REQUIRE(evaluator.evaluate("a.b[4] + a.b[3] * a.b[2]").as_number() == 5); // 3 + (2 * 1)
+    REQUIRE(evaluator.evaluate("(a.b[4] + a.b[3]) * a.b[3]").as_number() == 10);
+    REQUIRE(evaluator.evaluate("10 - 4 - 3").as_number() == 3); // Left-associative
+    REQUIRE(evaluator.evaluate("2 ** 3 ** 2").as_number() == 512); // Right-associative
+    REQUIRE(evaluator.evaluate("-2 ** 2").as_number() == -4);
+    REQUIRE(evaluator.evaluate("1.5e2 + 0.5").as_number() == 150.5);
+    REQUIRE(evaluator.evaluate("max(1, a.b[5], 2 * 15)").as_number() == 30);
+    REQUIRE(evaluator.evaluate("!a.b[0] && (a.b[2] || false)").as_bool() == true);
+
+    // A lone true, false or null is the literal, even when the document has such a key;
+    // longer paths starting with one of these words still walk the document
+    Evaluator keyed(JSON::parse(R"({"true": 5, "false": {"x": 7}, "null": [1]})"));
+    REQUIRE(keyed.evaluate("true").as_bool() == true);
+    REQUIRE(keyed.evaluate("false").as_bool() == false);
+    REQUIRE(keyed.evaluate("null").is_null());
+    REQUIRE(keyed.evaluate("false.x").as_number() == 7);
+    REQUIRE(keyed.evaluate("null[0]").as_number() == 1);
+}
+
+TEST_CASE("Compiled Expressions Are Reusable") {
+    CompiledExpression expr = CompiledExpression::compile("sum(x) / size(x)");
+    Evaluator first(JSON::parse(R"({"x": [1, 2, 3]})"));
+    Evaluator second(JSON::parse(R"({"x": [10, 20]})"));
+    REQUIRE(first.evaluate(expr).as_number() == 2);
+    REQUIRE(second.evaluate(expr).as_number() == 15);
+    REQUIRE(first.evaluate(expr).as_number() == 2);
+}
+
+TEST_CASE("Expression Syntax Errors") {
+    REQUIRE_THROWS_AS(CompiledExpression::compile("(1 + 2"), EvalError);
+    REQUIRE_THROWS_AS(CompiledExpression::compile("1 +"), EvalError);
+    REQUIRE_THROWS_AS(CompiledExpression::compile("a.b[x]"), EvalError);
+    REQUIRE_THROWS_AS(CompiledExpression::compile("unknown(1)"), EvalError);
+    REQUIRE_THROWS_AS(CompiledExpression::compile("abs(1, 2)"), EvalError);
+}
+
+TEST_CASE("Bytecode VM Matches Tree Walker") {
+    const char* expressions[] = {
+        "a.b[2] * a.b[3] + a.b[4]",
+        "-(a.b[5][1] - 25) ** 2 / 5",
+        "a.b[5][1] % a.b[4] + abs(-2.5) + round(2.5)",
+        "max(a.b[5]) - min(a.b[2], a.b[3]) + avg(a.b[5], 30) + size(a.b[6].c)",
+        "!a.b[0] || a.b[5][9]",
+        "a.b[6].c",
+    };
+    for (const char* expr : expressions) {
+        CompiledExpression compiled = CompiledExpression::compile(expr);
+        REQUIRE(evaluator.evaluate(compiled).to_string() == evaluator.evaluate_tree(compiled).to_string());
+    }
+    // Short-circuited operands are never evaluated
+    REQUIRE(evaluator.evaluate("a.b[0] && a.missing").as_bool() == false);
+    REQUIRE(evaluator.evaluate("a.b[2] || 1 / 0").as_bool() == true);
+    REQUIRE_THROWS_AS(evaluator.evaluate("a.b[2] && a.missing"), EvalError);
+
+    // When both operands fail, both report the left one's error
+    for (const char* expr : {"a.missing + a.b[6].c.x", "a.b[9] * (1 / 0)", "-a.b[6].c - a.gone"}) {
+        CompiledExpression compiled = CompiledExpression::compile(expr);
+        std::string vm_error, tree_error;
+        try {
+            evaluator.evaluate(compiled);
+        } catch (const EvalError& e) {
+            vm_error = e.what();
+        }
+        try {
+            evaluator.evaluate_tree(compiled);
+        } catch (const EvalError& e) {
+            tree_error = e.what();
+        }
+        INFO(expr);
+        REQUIRE_FALSE(vm_error.empty());
+        REQUIRE(tree_error == vm_error);
+    }
+}
+
+TEST_CASE("Numeric JIT Matches The Interpreter") {
+    const char* expressions[] = {
+        "a.b[2] * a.b[3] + a.b[4]",
+        "-(a.b[5][1] - 25) ** 2 / 5 + a.b[5][1] % a.b[4]",
+        "abs(a.b[2] - a.b[5][2]) + round(2.5) - round(-2.5)",
+        "max(a.b[2], a.b[5][1], 7) * min(a.b[3], a.b[4]) + max(a.b[4])",
+    };
+    for (const char* expr : expressions) {
+        CompiledExpression compiled = CompiledExpression::compile(expr);
+        JSONValue expected = evaluator.evaluate(compiled);
+        if (!compiled.enable_jit()) continue; // No native tier on this platform
+        REQUIRE(evaluator.evaluate(compiled).as_number() == expected.as_number());
+    }
+
+    // Only numeric expressions are compiled; errors are reported by the interpreter
+    REQUIRE_FALSE(CompiledExpression::compile("a.b[0] && a.b[1]").enable_jit());
+    REQUIRE_FALSE(CompiledExpression::compile("sum(a.b[5])").enable_jit());
+    CompiledExpression division = CompiledExpression::compile("a.b[4] / a.b[0]");
+    division.enable_jit();
+    REQUIRE_THROWS_AS(evaluator.evaluate(division), EvalError);
+    CompiledExpression not_a_number = CompiledExpression::compile("a.b[6].c + 1");
+    not_a_number.enable_jit();
+    REQUIRE_THROWS_AS(evaluator.evaluate(not_a_number), EvalError);
+    // '%' calls the interpreter's helper, so large operands and -1 agree across tiers
+    Evaluator big(JSON::parse(R"({"n": 123456789012, "m": -2147483648, "h": 0.5})"));
+    for (const char* expr : {"n % -1", "m % -1", "n % 1000", "-n % 7", "3000000000 % -1", "n % (m - 1)"}) {
+        CompiledExpression compiled = CompiledExpression::compile(expr);
+        JSONValue expected = big.evaluate(compiled);
+        if (!compiled.enable_jit()) continue;
+        INFO(expr);
+        REQUIRE(big.evaluate(compiled).as_number() == expected.as_number());
+    }
+    CompiledExpression by_half = CompiledExpression::compile("n % h");
+    by_half.enable_jit();
+    REQUIRE_THROWS_WITH(big.evaluate(by_half), "Division by zero");
+    CompiledExpression over_array = CompiledExpression::compile("max(a.b[5]) + 1");
+    over_array.enable_jit();
+    REQUIRE(evaluator.evaluate(over_array).as_number() == 21);
+}
+
+TEST_CASE("Thread Pool Runs Every Index Once") {
+    ThreadPool pool(3);
+    std::vector<std::atomic<int>> hits(1000);
+    pool.parallel_for(hits.size(), [&](size_t i) {
+        // Nested parallel calls are helped along by waiting threads
+        pool.parallel_for(2, [&](size_t) { hits[i]++; });
+    });
+    REQUIRE(std::all_of(hits.begin(), hits.end(), [](const std::atomic<int>& h) { return h == 2; }));
+    REQUIRE_THROWS_AS(pool.parallel_for(4, [](size_t i) { if (i == 2) throw EvalError("boom"); }), EvalError);
+}
+
+TEST_CASE("Expensive Aggregate Arguments Run On The Pool") {
+    ThreadPool pool(2);
+    Evaluator parallel(json);
+    parallel.set_thread_pool(&pool);
+    Evaluator serial(json);
+    serial.set_parallel_threshold(SIZE_MAX);
+    const char* expr = "max(sum(a.b[5]), avg(a.b[5]), min(a.b[5]) + 1, a.b[4])";
+    REQUIRE(parallel.evaluate(expr).as_number() == 30);
+    REQUIRE(serial.evaluate(expr).as_number() == 30);
+    REQUIRE(parallel.evaluate_tree(CompiledExpression::compile(expr)).as_number() == 30);
+    REQUIRE_THROWS_AS(parallel.evaluate("sum(sum(a.b[5]), sum(a.b[6]))"), EvalError);
+}
+
+TEST_CASE("Vectorized Reductions Match Scalar Loops") {
+    // Integral values keep sums exact regardless of the order lanes are added in
+    std::vector<double> values;
+    for (int i = 0; i < 1037; ++i) values.push_back(static_cast<double>((i * 37) % 101) - 50);
+
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+        if (level > detected_simd_level()) continue;
+        for (size_t n : {0, 1, 3, 7, 16, 17, 1037}) {
+            double sum = 0, lo = std::numeric_limits<double>::infinity(), hi = -lo;
+            for (size_t i = 0; i < n; ++i) {
+                sum += values[i];
+                lo = std::min(lo, values[i]);
+                hi = std::max(hi, values[i]);
+            }
+            REQUIRE(reduce_sum(values.data(), n, level) == sum);
+            REQUIRE(reduce_min(values.data(), n, level) == lo);
+            REQUIRE(reduce_max(values.data(), n, level) == hi);
+        }
+    }
+
+    std::string text = "{\"a\": [";
+    for (size_t i = 0; i < values.size(); ++i) text += (i ? ", " : "") + std::to_string(static_cast<int>(values[i]));
+    text += "]}";
+    Evaluator large(JSONDocument::parse(text));
+    REQUIRE(large.evaluate("min(a, 100)").as_number() == -50);
+    REQUIRE(large.evaluate("max(-100, a)").as_number() == 50);
+    REQUIRE(large.evaluate("sum(a) - sum(a)").as_number() == 0);
+    REQUIRE(large.evaluate("avg(a, a)").as_number() == large.evaluate("avg(a)").as_number());
+}
+
+TEST_CASE("Numeric Arrays Are Packed") {
+    JSONValue packed = JSON::parse("[1, 2.5, -3]");
+    REQUIRE(packed.is_array());
+    REQUIRE(packed.is_number_array());
+    REQUIRE(packed.array_size() == 3);
+    REQUIRE(packed.as_number_array()[1] == 2.5);
+    REQUIRE_THROWS_AS(packed.as_array(), JSONError);
+    REQUIRE(packed.to_string() == "[1,2.5,-3]");
+
+    // One non-number keeps the whole array generic
+    JSONValue mixed = JSON::parse("[1, 2, \"x\"]");
+    REQUIRE_FALSE(mixed.is_number_array());
+    REQUIRE(mixed.as_array()[1].as_number() == 2);
+    REQUIRE_FALSE(JSON::parse("[]").is_number_array());
+
+    JSONDocumentPtr document = JSONDocument::parse(R"({"n": [4, 8, 15, 16, 23, 42], "m": [[1, 2], [3]]})");
+    Evaluator packed_evaluator(document);
+    REQUIRE(packed_evaluator.evaluate("n[2] + m[0][1]").as_number() == 17);
+    REQUIRE(packed_evaluator.evaluate("sum(n) + max(m[0], m[1]) + size(n)").as_number() == 117);
+    REQUIRE(packed_evaluator.evaluate("avg(n)").as_number() == 18);
+    REQUIRE(packed_evaluator.evaluate("n").as_array().size() == 6);
+    REQUIRE_THROWS_AS(packed_evaluator.evaluate("n[6]"), EvalError);
+    REQUIRE_THROWS_AS(packed_evaluator.evaluate("n[0][0]"), EvalError);
+    REQUIRE_THROWS_AS(packed_evaluator.evaluate("n[0].x"), EvalError);
+
+    // Results are unpacked at every depth, so as_array() reads them whatever the nesting
+    JSONDocumentPtr nested = JSONDocument::parse(R"({"a": {"b": [1, 2], "c": [[3], {"d": [4]}], "e": "x"}})");
+    JSONValue a = Evaluator(nested).evaluate("a");
+    REQUIRE(a.as_object().at("b").as_array()[1].as_number() == 2);
+    REQUIRE(a.as_object().at("c").as_array()[0].as_array()[0].as_number() == 3);
+    REQUIRE(a.as_object().at("c").as_array()[1].as_object().at("d").as_array()[0].as_number() == 4);
+    REQUIRE(a.as_object().at("e").as_string() == "x");
+    REQUIRE(Evaluator(nested).evaluate("a.c").as_array()[0].as_array().size() == 1);
+    REQUIRE(nested->root().as_object().at("a").as_object().at("b").is_number_array()); // The document keeps its form
+
+    CompiledExpression native = CompiledExpression::compile("n[5] - n[0] * 2");
+    native.enable_jit();
+    REQUIRE(packed_evaluator.evaluate(native).as_number() == 34);
+}
+
+TEST_CASE("Arena Documents Evaluate Like Heap Documents") {
+    const std::string text = R"({"a": {"b": [0, 0, 1, 2, 3, [0, 10, 20], {"c": "a string too long for SSO"}]}, "a": {"b": [5]}})";
+    JSONDocumentPtr heap = JSONDocument::parse(text);
+    JSONDocumentPtr arena = JSONDocument::parse(text, JSONDocument::Arena);
+    REQUIRE(arena->root().to_string() == heap->root().to_string());
+
+    JSONValue detached;
+    {
+        Evaluator arena_evaluator(arena);
+        arena.reset();
+        REQUIRE(arena_evaluator.evaluate("a.b[0] * 2").as_number() == 10); // Last duplicate key wins
+        detached = Evaluator(JSONDocument::parse(text, JSONDocument::Arena)).evaluate("a");
+    }
+    // Results are copied onto the heap, so they outlive the arena
+    REQUIRE(detached.as_object().at("b").as_array()[0].as_number() == 5);
+}
+
+TEST_CASE("Mapped Files Feed The Parser Directly") {
+    const std::string path = "mapped_file_test.json";
+    {
+        std::ofstream out(path);
+        out << R"({"a": {"b": [1, 2, 3]}})";
+    }
+    {
+        MappedFile file(path);
+        REQUIRE(file.is_mapped());
+        Evaluator mapped(JSONDocument::parse(file.view()));
+        REQUIRE(mapped.evaluate("sum(a.b)").as_number() == 6);
+    }
+    {
+        std::ofstream truncate(path);
+    }
+    {
+        // Empty files cannot be mapped and are read instead
+        MappedFile empty(path);
+        REQUIRE_FALSE(empty.is_mapped());
+        REQUIRE(empty.view().empty());
+    }
+    std::remove(path.c_str());
+    REQUIRE_THROWS_AS(MappedFile(path), JSONError);
+}
+
+TEST_CASE("Structural Parser Matches The Character Parser") {
+    // Backslash runs and strings are placed to straddle 64-byte block boundaries
+    std::string padding(58, ' ');
+    std::vector<std::string> documents = {
+        R"({"a": {"b": [0, 0, 1, 2, 3, [0, 10, 20], {"c": "test"}]}})",
+        "  [1, -2.5, 0.125, true, false, null, \"x\"]  ",
+        "{" + padding + "\"k\\\\\\\"ey\": \"va\\\\\", \"s\": \"{[,:]}\\\"\"}",
+        "[\"" + std::string(61, 'q') + "\\\\\", \"" + std::string(70, 'z') + "\\n\"]",
+        "{\"empty\": {}, \"list\": [], \"nested\": [[[]], {\"x\": [{}]}], \"dup\": 1, \"dup\": 2}",
+        "-0.5",
+        "\"tab\\tnew\\nline \\/ slash\"",
+    };
+    for (const std::string& text : documents) {
+        JSONValue expected = JSON::parse(text);
+        REQUIRE(StructuralParser::parse(text).to_string() == expected.to_string());
+        std::vector<uint32_t> positions = StructuralParser::index(text, SimdLevel::Scalar);
+        for (SimdLevel level : {SimdLevel::SSE2, SimdLevel::AVX2}) {
+            if (level <= detected_simd_level()) REQUIRE(StructuralParser::index(text, level) == positions);
+        }
+    }
+
+    JSONDocumentPtr document = JSONDocument::parse(documents[0], JSONDocument::Arena, JSONDocument::Structural);
+    REQUIRE(Evaluator(document).evaluate("a.b[5][2] + size(a.b[6].c)").as_number() == 24);
+
+    for (const char* bad : {"", "[1, 2", "{\"a\" 1}", "{\"a\": 1,}", "[1 2]", "[01]", "[tru]", "\"open",
+                            "{\"a\": 1} x", "[1.]", "[\"bad \\q escape\"]", "{1: 2}", "[1]]"}) {
+        REQUIRE_THROWS_AS(StructuralParser::parse(bad), JSONError);
+    }
+
+    // Both take exactly JSON's four whitespace characters
+    REQUIRE(JSON::parse(" \t\r\n[ 1 ,\t2 ]\n").to_string() == "[1,2]");
+    REQUIRE(StructuralParser::parse(" \t\r\n[ 1 ,\t2 ]\n").to_string() == "[1,2]");
+    for (const char* bad : {"\f[1]", "[1,\v2]", "{\"a\":\f1}", "[1\v]"}) {
+        REQUIRE_THROWS_AS(JSON::parse(bad), JSONError);
+        REQUIRE_THROWS_AS(StructuralParser::parse(bad), JSONError);
+    }
+}
+
+TEST_CASE("Numbers Parse Exactly") {
+    auto parse = [](const std::string& text) {
+        ParsedNumber number;
+        const char* end = parse_json_number(text.data(), text.data() + text.size(), number);
+        REQUIRE(end == text.data() + text.size());
+        return number;
+    };
+    REQUIRE(parse("1e9").number == 1e9);
+    REQUIRE(parse("-2.5E-3").number == -2.5e-3);
+    REQUIRE(parse("0.000123").number == 0.000123);
+    REQUIRE(parse("12345678901234567.5").number == 12345678901234567.5);
+    REQUIRE(parse("1e-400").number == 0);
+    REQUIRE(std::signbit(parse("-0").number));
+    REQUIRE_FALSE(parse("-0").is_integer);
+    REQUIRE_THROWS_AS(parse("1e400"), JSONError);
+
+    // Integers that fit in int64 are kept exact
+    REQUIRE(parse("9007199254740993").integer == 9007199254740993);
+    REQUIRE(parse("-9223372036854775808").integer == std::numeric_limits<int64_t>::min());
+    REQUIRE(parse("9223372036854775807").integer == std::numeric_limits<int64_t>::max());
+    REQUIRE_FALSE(parse("9223372036854775808").is_integer);
+    REQUIRE_FALSE(parse("1.0").is_integer);
+
+    // Fast paths agree with std::from_chars bit for bit
+    std::mt19937_64 random(42);
+    int mismatches = 0;
+    for (int i = 0; i < 20000; ++i) {
+        std::string text = std::to_string(random() >> (random() % 64));
+        if (i % 3 && text.size() > 1) text.insert(1 + random() % (text.size() - 1), ".");
+        if (i % 5 == 0) text += "e" + std::to_string(static_cast<int>(random() % 80) - 40);
+        double expected = 0;
+        std::from_chars(text.data(), text.data() + text.size(), expected);
+        ParsedNumber number;
+        parse_json_number(text.data(), text.data() + text.size(), number);
+        if (number.number != expected) mismatches++;
+    }
+    REQUIRE(mismatches == 0);
+
+    for (const char* bad : {"-", "+1", "1.", ".5", "1e", "1e+", "-x"}) {
+        ParsedNumber number;
+        std::string text = bad;
+        REQUIRE_THROWS_AS(parse_json_number(text.data(), text.data() + text.size(), number), JSONError);
+    }
+
+    JSONValue values = JSON::parse(R"({"big": [1, 9007199254740993], "small": [1, 2e3], "id": 1234567890123456789})");
+    REQUIRE(values.as_object().at("small").is_number_array());
+    REQUIRE(values.as_object().at("big").as_array()[1].as_integer() == 9007199254740993);
+    REQUIRE(StructuralParser::parse(values.to_string()).to_string() == values.to_string());
+    Evaluator numbers(values);
+    REQUIRE(numbers.evaluate("id").as_integer() == 1234567890123456789);
+    REQUIRE(numbers.evaluate("id").to_string() == "1234567890123456789");
+    REQUIRE(numbers.evaluate("small[1] * 2").as_number() == 4000);
+}
+
+TEST_CASE("Numbers Format As Shortest Round Trip") {
+    auto format = [](double value) {
+        char buffer[MAX_NUMBER_LENGTH];
+        return std::string(buffer, format_json_number(value, buffer));
+    };
+    REQUIRE(format(0.1) == "0.1");
+    REQUIRE(format(1e9) == "1000000000");
+    REQUIRE(format(-2.5) == "-2.5");
+    REQUIRE(format(1e300) == "1e+300");
+    REQUIRE(format(-0.0) == "-0");
+    REQUIRE(format(std::numeric_limits<double>::infinity()) == "null");
+    REQUIRE(JSONValue(int64_t(-9223372036854775807 - 1)).to_string() == "-9223372036854775808");
+
+    // Every double survives a format/parse round trip
+    std::mt19937_64 random(7);
+    int mismatches = 0;
+    for (int i = 0; i < 20000; ++i) {
+        uint64_t bits = random();
+        double value;
+        std::memcpy(&value, &bits, sizeof value);
+        if (!std::isfinite(value)) continue;
+        std::string text = format(value);
+        ParsedNumber number;
+        parse_json_number(text.data(), text.data() + text.size(), number);
+        if (number.number != value) mismatches++;
+    }
+    REQUIRE(mismatches == 0);
+    REQUIRE(JSON::parse("[0.30000000000000004, 123456.789]").to_string() == "[0.30000000000000004,123456.789]");
+}
+
+TEST_CASE("Writer Escapes And Pretty Prints") {
+    JSONValue value = JSON::parse(R"({"s": "quote \" slash \\ tab \t", "n": [1, 2.5], "e": [], "o": {"k": [true, null, "x"]}})");
+    std::string control = "\x01";
+    REQUIRE(JSONValue(control).to_string() == "\"\\u0001\"");
+    REQUIRE(value.to_string() == R"({"e":[],"n":[1,2.5],"o":{"k":[true,null,"x"]},"s":"quote \" slash \\ tab \t"})");
+    REQUIRE(JSON::parse(value.to_string()).to_string() == value.to_string());
+
+    JSONWriter pretty(JSONWriter::Pretty);
+    pretty.write(JSON::parse(R"({"a": [1, {"b": null}], "c": {}})"));
+    REQUIRE(pretty.str() == "{\n  \"a\": [\n    1,\n    {\n      \"b\": null\n    }\n  ],\n  \"c\": {}\n}");
+
+    // A descriptor-backed writer flushes as it goes and keeps little buffered
+    const std::string path = "writer_test.json";
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    REQUIRE(file != nullptr);
+    {
+        JSONWriter streaming(fileno(file), JSONWriter::Compact, 64);
+        JSONArray items;
+        for (int i = 0; i < 1000; ++i) items.push_back(JSONValue("item " + std::to_string(i)));
+        streaming.write(JSONValue(items));
+        REQUIRE(streaming.str().size() < 128);
+    }
+    std::fclose(file);
+    {
+        MappedFile written(path);
+        JSONValue items = JSON::parse(written.view());
+        REQUIRE(items.array_size() == 1000);
+        REQUIRE(items.as_array()[999].as_string() == "item 999");
+    }
+    std::remove(path.c_str());
+}
+
+TEST_CASE("Strings Decode Escapes And Validate UTF-8") {
+    auto decode = [](const std::string& body, SimdLevel level = detected_simd_level()) {
+        std::string text = body + "\"";
+        JSONString out;
+        const char* end = parse_json_string(text.data(), text.data() + text.size(), out, level);
+        REQUIRE(end == text.data() + text.size());
+        return std::string(out);
+    };
+    REQUIRE(decode("plain") == "plain");
+    REQUIRE(decode("a\\\"b\\\\c\\/d\\b\\f\\n\\r\\t") == "a\"b\\c/d\b\f\n\r\t");
+    REQUIRE(decode("\\u0041\\u00e9\\u20AC") == "A\xC3\xA9\xE2\x82\xAC");
+    REQUIRE(decode("\\ud83d\\ude00") == "\xF0\x9F\x98\x80");
+    REQUIRE(decode("caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80") == "caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80");
+
+    // Specials at every offset across the 16- and 32-byte scan widths, at every SIMD level
+    for (size_t offset = 0; offset < 70; ++offset) {
+        std::string prefix(offset, 'x');
+        for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+            if (level > detected_simd_level()) continue;
+            REQUIRE(decode(prefix + "\\n" + prefix, level) == prefix + "\n" + prefix);
+            REQUIRE(decode(prefix + "\xC3\xA9", level) == prefix + "\xC3\xA9");
+            REQUIRE_THROWS_AS(decode(prefix + "\x01", level), JSONError);
+        }
+    }
+
+    for (const char* bad : {"\\ud83d", "\\ud83dx", "\\ude00", "\\ud83d\\u0041", "\\u12", "\\u12g4", "\\x",
+                            "\xC0\xAF", "\xE0\x80\xAF", "\xED\xA0\x80", "\xF4\x90\x80\x80", "\xF8", "\x80",
+                            "\xC3", "\xE2\x82", "tab\there"}) {
+        REQUIRE_THROWS_AS(decode(bad), JSONError);
+    }
+    JSONString out;
+    std::string open = "no closing quote";
+    REQUIRE_THROWS_AS(parse_json_string(open.data(), open.data() + open.size(), out), JSONError);
+
+    // Both parsers share the decoder
+    std::string text = "{\"k\\u00e9y\": [\"\\ud83d\\ude00\", \"" + std::string(40, 'a') + "\\\"\"]}";
+    REQUIRE(StructuralParser::parse(text).to_string() == JSON::parse(text).to_string());
+    REQUIRE(JSON::parse(text).as_object().count("k\xC3\xA9y") == 1);
+}
+
+TEST_CASE("Lazy Strings Decode On First Access") {
+    std::string text = R"({"plain": "hello", "escaped": "tab\there é 😀 \"q\"", "list": ["a\nb", "c", {"kA": "v\\w"}]})";
+    std::string expected = JSON::parse(text).to_string();
+    for (auto backend : {JSONDocument::Character, JSONDocument::Structural}) {
+        for (auto allocation : {JSONDocument::Heap, JSONDocument::Arena}) {
+            std::string input = text;
+            JSONDocumentPtr document = JSONDocument::parse(input, allocation, backend, JSONDocument::Lazy);
+            std::fill(input.begin(), input.end(), 'x'); // The document keeps its own copy
+            REQUIRE(document->root().to_string() == expected);
+            REQUIRE(document->root().to_string() == expected); // Decoding twice changes nothing
+            REQUIRE(document->root().as_object().count("kA") == 0); // Keys are always decoded
+            REQUIRE(document->root().as_object().at("list").as_array()[2].as_object().count("kA") == 1);
+        }
+    }
+
+    // Concurrent first reads of one escaped string all see the decoded text
+    JSONDocumentPtr document = JSONDocument::parse(R"(["a\"béc\\d"])", JSONDocument::Heap,
+                                                   JSONDocument::Character, JSONDocument::Lazy);
+    std::vector<std::string> seen(4);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < seen.size(); ++i) {
+        threads.emplace_back([&, i] { seen[i] = std::string(document->root().as_array()[0].as_string()); });
+    }
+    for (auto& t : threads) t.join();
+    for (const std::string& s : seen) REQUIRE(s == "a\"b\xC3\xA9" "c\\d");
+
+    // Copies are decoded strings that outlive the document
+    JSONValue copy = document->root();
+    document.reset();
+    REQUIRE(copy.as_array()[0].as_string() == "a\"b\xC3\xA9" "c\\d");
+    REQUIRE(Evaluator(JSONDocument::parse(R"({"s": "x\ny"})", JSONDocument::Arena, JSONDocument::Structural,
+                                          JSONDocument::Lazy)).evaluate("s").as_string() == "x\ny");
+
+    // Validation still happens while parsing
+    for (const char* bad : {R"(["\q"])", R"(["\ud800"])", "[\"\xC0\xAF\"]", "[\"raw\ttab\"]"}) {
+        REQUIRE_THROWS_AS(JSONDocument::parse(bad, JSONDocument::Heap, JSONDocument::Character, JSONDocument::Lazy), JSONError);
+        REQUIRE_THROWS_AS(JSONDocument::parse(bad, JSONDocument::Heap, JSONDocument::Structural, JSONDocument::Lazy), JSONError);
+    }
+}
+
+TEST_CASE("Objects Stay Sorted With Indexed Lookup") {
+    // Sizes on both sides of the hashed threshold, keys written in reverse order
+    for (size_t size : {size_t(0), size_t(1), size_t(5), JSONShape::HASHED_SIZE - 1, JSONShape::HASHED_SIZE, size_t(300)}) {
+        std::string text = "{";
+        for (size_t i = size; i-- > 0;) text += "\"k" + std::to_string(i) + "\": " + std::to_string(i) + (i ? ", " : "");
+        text += "}";
+        for (JSONValue parsed : {JSON::parse(text), StructuralParser::parse(text)}) {
+            const JSONObject& object = parsed.as_object();
+            REQUIRE(object.size() == size);
+            REQUIRE(std::is_sorted(object.begin(), object.end(), [](const auto& a, const auto& b) { return a.first->name < b.first->name; }));
+            for (size_t i = 0; i < size; ++i) REQUIRE(object.at("k" + std::to_string(i)).as_integer() == static_cast<int64_t>(i));
+            REQUIRE(object.find("k") == object.end());
+            REQUIRE(object.count("missing") == 0);
+            REQUIRE_THROWS_AS(object.at("missing"), JSONError);
+            JSONValue copy = parsed; // Copies keep a working index
+            if (size) REQUIRE(copy.as_object().at("k0").as_integer() == 0);
+        }
+    }
+
+    // Of duplicate keys the last one wins, in small and hashed objects alike
+    std::string duplicates = R"({"b": 1, "a": 2, "b": 3)";
+    for (int i = 0; i < 40; ++i) duplicates += ", \"x" + std::to_string(i) + "\": " + std::to_string(i);
+    duplicates += R"(, "a": 4})";
+    for (JSONValue parsed : {JSON::parse(R"({"b": 1, "a": 2, "b": 3, "a": 4})"), JSON::parse(duplicates),
+                             StructuralParser::parse(duplicates)}) {
+        REQUIRE(parsed.as_object().at("a").as_integer() == 4);
+        REQUIRE(parsed.as_object().at("b").as_integer() == 3);
+    }
+    REQUIRE(JSON::parse(R"({"b": 1, "a": 2, "b": 3, "a": 4})").to_string() == R"({"a":4,"b":3})");
+
+    JSONObject built;
+    for (int i = 20; i-- > 0;) built.insert_or_assign("n" + std::to_string(i), JSONValue(i));
+    built.insert_or_assign("n7", JSONValue("seven"));
+    REQUIRE(built.size() == 20);
+    REQUIRE(built.at("n7").as_string() == "seven");
+    REQUIRE(built.at("n19").as_integer() == 19);
+    REQUIRE(built.begin()->first->name == "n0");
+}
+
+TEST_CASE("Document Keys Are Interned Once") {
+    std::string text = "[";
+    for (int i = 0; i < 100; ++i) text += std::string(i ? ", " : "") + R"({"id": 1, "price": 2.5, "kA": [{"id": 0}]})";
+    text += "]";
+    for (auto backend : {JSONDocument::Character, JSONDocument::Structural}) {
+        JSONDocumentPtr document = JSONDocument::parse(text, JSONDocument::Arena, backend);
+        REQUIRE(document->keys().size() == 3); // id, price and the decoded kA
+        const JSONKey* id = document->keys().find("id");
+        REQUIRE(id != nullptr);
+        REQUIRE(document->keys().find("kA") != nullptr);
+        REQUIRE(document->keys().find("missing") == nullptr);
+        const JSONArray& items = document->root().as_array();
+        for (const JSONValue& item : items) {
+            REQUIRE(item.as_object().find(id)->first == id);
+            const JSONObject& nested = item.as_object().at("kA").as_array()[0].as_object();
+            REQUIRE(nested.find(id) != nested.end());
+        }
+
+        Evaluator evaluator(document);
+        REQUIRE_THROWS_WITH(evaluator.evaluate("missing"), "Invalid key access on non-object type: missing");
+    }
+
+    JSONDocumentPtr document = JSONDocument::parse(R"({"a": {"b": 1}, "c": 2})");
+    Evaluator evaluator(document);
+    REQUIRE(evaluator.evaluate("a.b + c").as_number() == 3);
+    REQUIRE_THROWS_WITH(evaluator.evaluate("a.x"), "Key not found: x");
+    JSONValue copy = evaluator.evaluate("a"); // Copied out, holding on to the document's keys
+    const KeyTable* keys = &document->keys();
+    document.reset();
+    REQUIRE(copy.as_object().at("b").as_integer() == 1);
+    REQUIRE(copy.as_object().shape().table == keys);
+    REQUIRE(copy.as_object().find(keys->find("b")) != copy.as_object().end());
+
+    // The shared table hands out one key per name, whichever thread asks first
+    std::vector<const JSONKey*> seen(8);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < seen.size(); ++i) {
+        threads.emplace_back([&, i] {
+            for (int n = 0; n < 200; ++n) KeyTable::shared().intern("concurrent_" + std::to_string(n));
+            seen[i] = KeyTable::shared().intern("concurrent_7");
+        });
+    }
+    for (auto& t : threads) t.join();
+    for (const JSONKey* key : seen) REQUIRE(key == seen[0]);
+    REQUIRE(seen[0]->name == "concurrent_7");
+}
+
+TEST_CASE("Objects With The Same Keys Share A Shape") {
+    std::string text = R"({"items": [{"id": 1, "price": 2.5, "qty": 3}, {"qty": 4, "price": 1.5, "id": 2},
+                                    {"id": 3, "price": 9}, {"price": 7, "id": 4, "qty": 1, "qty": 5}]})";
+    for (auto backend : {JSONDocument::Character, JSONDocument::Structural}) {
+        JSONDocumentPtr document = JSONDocument::parse(text, JSONDocument::Arena, backend);
+        const JSONArray& items = document->root().as_object().at("items").as_array();
+        REQUIRE(&items[0].as_object().shape() == &items[1].as_object().shape()); // Key order does not matter
+        REQUIRE(&items[0].as_object().shape() == &items[3].as_object().shape()); // Nor do duplicates
+        REQUIRE(&items[0].as_object().shape() != &items[2].as_object().shape());
+        REQUIRE(document->keys().shape_count() == 3); // The root, {id, price, qty} and {id, price}
+        REQUIRE(items[3].as_object().at("qty").as_integer() == 5);
+
+        // Run every path twice so the second pass goes through the warm cache
+        Evaluator evaluator(document);
+        std::vector<CompiledExpression> prices;
+        for (int i = 0; i < 4; ++i) prices.push_back(CompiledExpression::compile("items[" + std::to_string(i) + "].price + 0"));
+        for (int pass = 0; pass < 2; ++pass) {
+            REQUIRE(evaluator.evaluate(prices[0]).as_number() == 2.5);
+            REQUIRE(evaluator.evaluate(prices[1]).as_number() == 1.5);
+            REQUIRE(evaluator.evaluate(prices[2]).as_number() == 9);
+            REQUIRE(evaluator.evaluate(prices[3]).as_number() == 7);
+        }
+    }
+
+    // One compiled path against objects whose shapes put the key in other slots, or lack it
+    CompiledExpression price = CompiledExpression::compile("x.price");
+    std::vector<JSONDocumentPtr> documents = {JSONDocument::parse(R"({"x": {"a": 1, "price": 2}})"),
+                                              JSONDocument::parse(R"({"x": {"price": 3}})"),
+                                              JSONDocument::parse(R"({"x": {"b": 1}})")};
+    for (int pass = 0; pass < 3; ++pass) {
+        REQUIRE(Evaluator(documents[0]).evaluate(price).as_number() == 2);
+        REQUIRE(Evaluator(documents[1]).evaluate(price).as_number() == 3);
+        REQUIRE_THROWS_WITH(Evaluator(documents[2]).evaluate(price), "Key not found: price");
+    }
+
+    // Wide shapes are indexed. Copies keep the shape, and edits move an object to a table of its own
+    std::string wide = "[";
+    for (int copy = 0; copy < 2; ++copy) {
+        wide += copy ? ", {" : "{";
+        for (int i = 0; i < 40; ++i) wide += (i ? ", \"f" : "\"f") + std::to_string(i) + "\": " + std::to_string(i * copy);
+        wide += "}";
+    }
+    wide += "]";
+    JSONDocumentPtr document = JSONDocument::parse(wide);
+    const JSONObject& second = document->root().as_array()[1].as_object();
+    REQUIRE(&document->root().as_array()[0].as_object().shape() == &second.shape());
+    REQUIRE(second.shape().slots != nullptr);
+    REQUIRE(second.at("f39").as_integer() == 39);
+    JSONValue copy = document->root().as_array()[1];
+    REQUIRE(&copy.as_object().shape() == &second.shape());
+    REQUIRE(copy.as_object().at("f17").as_integer() == 17);
+    JSONObject edited = copy.as_object();
+    edited.insert_or_assign("extra", JSONValue(true));
+    REQUIRE(edited.size() == 41);
+    REQUIRE(edited.at("extra").as_bool());
+    REQUIRE(edited.at("f0").as_integer() == 0);
+    REQUIRE(&edited.shape() != &copy.as_object().shape());
+    REQUIRE(edited.shape().table != &document->keys());
+}
+
+// Forwards to the default heap and keeps count, so tests can see what a value allocates
+class CountingResource : public std::pmr::memory_resource {
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        ++allocations;
+        live += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        live -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+public:
+    size_t allocations = 0;
+    size_t live = 0; // Bytes allocated and not yet freed
+};
+
+TEST_CASE("Values Are Sixteen Bytes") {
+    REQUIRE(sizeof(JSONValue) == 16);
+
+    // Scalars and strings of up to 14 bytes stay in the value; longer ones carry their resource
+    CountingResource counting;
+    {
+        JSONValue small(std::string_view("fourteen bytes"), &counting);
+        JSONValue large(std::string_view("fifteen bytes!!"), &counting);
+        REQUIRE(counting.allocations == 1);
+        REQUIRE(small.as_string() == "fourteen bytes");
+        REQUIRE(large.as_string() == "fifteen bytes!!");
+        JSONValue moved = std::move(large);
+        REQUIRE(large.is_null());
+        REQUIRE(moved.as_string() == "fifteen bytes!!");
+        JSONValue copy = moved;
+        REQUIRE(counting.allocations == 1); // Copies go to the default heap
+        REQUIRE(copy.as_string() == moved.as_string());
+    }
+    REQUIRE(counting.live == 0);
+
+    // Containers are placed in their own resource and freed with the value
+    {
+        JSONArray items(&counting);
+        items.push_back(JSONValue(int64_t(9007199254740993)));
+        items.push_back(JSONValue(-0.5));
+        items.push_back(JSONValue(std::string_view("a string longer than fourteen"), &counting));
+        JSONValue array(std::move(items));
+        JSONValue holder{JSONArray(&counting)};
+        holder = std::move(array); // Frees the empty array it held
+        REQUIRE(holder.array_size() == 3);
+        REQUIRE(holder.as_array()[0].as_integer() == 9007199254740993);
+        REQUIRE(holder.as_array()[1].as_number() == -0.5);
+        REQUIRE(holder.to_string() == R"([9007199254740993,-0.5,"a string longer than fourteen"])");
+    }
+    REQUIRE(counting.live == 0);
+
+    // Strings on either side of the inline limit parse the same in every mode
+    std::string text = R"({"e": "", "s": "fourteen bytes", "l": "fifteen bytes!!", "x": "escéped and long enough",
+                          "n": [1, 2.5], "t": true, "z": null})";
+    for (auto allocation : {JSONDocument::Heap, JSONDocument::Arena}) {
+        for (auto backend : {JSONDocument::Character, JSONDocument::Structural}) {
+            for (auto strings : {JSONDocument::Decoded, JSONDocument::Lazy}) {
+                JSONDocumentPtr document = JSONDocument::parse(text, allocation, backend, strings);
+                const JSONObject& root = document->root().as_object();
+                REQUIRE(root.at("e").as_string().empty());
+                REQUIRE(root.at("s").as_string() == "fourteen bytes");
+                REQUIRE(root.at("l").as_string() == "fifteen bytes!!");
+                REQUIRE(root.at("x").as_string() == "esc\xC3\xA9ped and long enough");
+                REQUIRE(root.at("n").as_number_array()[1] == 2.5);
+                REQUIRE(root.at("t").as_bool());
+                REQUIRE(root.at("z").is_null());
+                JSONValue copy = document->root();
+                document.reset();
+                REQUIRE(copy.to_string() == R"({"e":"","l":"fifteen bytes!!","n":[1,2.5],"s":"fourteen bytes","t":true,)"
+                                            R"("x":"escéped and long enough","z":null})");
+            }
+        }
+    }
+}
+
+TEST_CASE("Parsing Allocates Each Container Once") {
+    auto nested = [](const std::string& open, const std::string& close, size_t depth) {
+        std::string text;
+        for (size_t i = 0; i < depth; ++i) text += open;
+        text += "1";
+        for (size_t i = 0; i < depth; ++i) text += close;
+        return text;
+    };
+    std::string records = R"({"items": [)";
+    for (int i = 0; i < 100; ++i) records += (i ? ", " : "") + std::string(R"({"id": 1, "name": "short", "tags": [1, 2, 3]})");
+    records += "]}";
+    std::string mixed = "[";
+    for (int i = 0; i < 1000; ++i) mixed += i % 2 ? "\"abc\", " : "true, ";
+    mixed += "9223372036854775807, null]";
+
+    // Each container is its node plus one buffer of its final size, however deep it sits,
+    // as long as no long string needs storage of its own
+    std::vector<std::pair<std::string, size_t>> cases = {
+        {nested("[", "]", 1), 2},       {nested("[", "]", 100), 200},     {nested("{\"k\": ", "}", 100), 200},
+        {nested("[{\"k\": ", "}]", 50), 200}, {records, 2 + 2 + 100 * 4}, {mixed, 2},
+        {"[1, 2, 3, 4, 5, 6, 7, 8, 9, 10.5]", 2}, {R"("a string longer than fourteen")", 1}, {"[]", 1}};
+    for (const auto& entry : cases) {
+        for (bool structural : {false, true}) {
+            CountingResource counting;
+            {
+                JSONValue tree = structural ? StructuralParser::parse(entry.first, &counting) : JSON::parse(entry.first, &counting);
+                INFO(entry.first.substr(0, 40) << (structural ? " (structural)" : " (character)"));
+                REQUIRE(counting.allocations == entry.second);
+                REQUIRE(tree.to_string() == JSON::parse(entry.first).to_string());
+            }
+            REQUIRE(counting.live == 0);
+        }
+    }
+}
+
+TEST_CASE("Parsers Track Nesting Without Recursion") {
+    auto nested = [](size_t depth) {
+        std::string text;
+        for (size_t i = 0; i < depth; ++i) text += i % 2 ? "[" : "{\"k\": ";
+        text += "1";
+        for (size_t i = depth; i-- > 0;) text += i % 2 ? "]" : "}";
+        return text;
+    };
+    auto parse = [](const std::string& text, bool structural, size_t max_depth) {
+        if (structural) return StructuralParser::parse(text, std::pmr::get_default_resource(), false, nullptr, max_depth);
+        return JSON::parse(text, std::pmr::get_default_resource(), false, nullptr, max_depth);
+    };
+    for (bool structural : {false, true}) {
+        // The limit counts open containers
+        REQUIRE_NOTHROW(parse(nested(JSON_MAX_DEPTH), structural, JSON_MAX_DEPTH));
+        REQUIRE_THROWS_WITH(parse(nested(JSON_MAX_DEPTH + 1), structural, JSON_MAX_DEPTH), "Maximum nesting depth exceeded");
+        REQUIRE(parse(nested(3), structural, 3).to_string() == R"({"k":[{"k":1}]})");
+        REQUIRE_THROWS_WITH(parse(nested(4), structural, 3), "Maximum nesting depth exceeded");
+        REQUIRE(parse("7", structural, 0).as_integer() == 7);
+        REQUIRE_THROWS_WITH(parse("[]", structural, 0), "Maximum nesting depth exceeded");
+
+        // Pathological input fails cleanly instead of exhausting the call stack
+        REQUIRE_THROWS_WITH(parse(std::string(1000000, '['), structural, JSON_MAX_DEPTH), "Maximum nesting depth exceeded");
+
+        // Errors inside nested containers are reported as before
+        REQUIRE_THROWS_WITH(parse("[[1, 2}", structural, JSON_MAX_DEPTH), "Expected ',' or ']'");
+        REQUIRE_THROWS_WITH(parse(R"([{"a": 1]])", structural, JSON_MAX_DEPTH), "Expected ',' or '}'");
+        REQUIRE_THROWS_WITH(parse(R"([{"a" 1}])", structural, JSON_MAX_DEPTH), "Expected ':'");
+        REQUIRE_THROWS_WITH(parse("[{1: 2}]", structural, JSON_MAX_DEPTH), "Expected string key");
+        REQUIRE_THROWS_WITH(parse("[[1, ]]", structural, JSON_MAX_DEPTH), "Invalid JSON value");
+
+        // Packed and generic arrays side by side at several levels
+        JSONValue mixed = parse(R"([[1, 2], [3, "x"], [], [[4.5]], 9007199254740993, {}])", structural, JSON_MAX_DEPTH);
+        const JSONArray& items = mixed.as_array();
+        REQUIRE(items[0].is_number_array());
+        REQUIRE_FALSE(items[1].is_number_array());
+        REQUIRE_FALSE(items[2].is_number_array());
+        REQUIRE(items[3].as_array()[0].is_number_array());
+        REQUIRE(items[4].as_integer() == 9007199254740993);
+        REQUIRE(mixed.to_string() == R"([[1,2],[3,"x"],[],[[4.5]],9007199254740993,{}])");
+    }
+
+    // With a raised limit, arena documents take very deep input; they are released without walking the tree
+    std::string deep = nested(200000);
+    for (auto backend : {JSONDocument::Character, JSONDocument::Structural}) {
+        JSONDocumentPtr document = JSONDocument::parse(deep, JSONDocument::Arena, backend, JSONDocument::Decoded, 200000);
+        const JSONValue* node = &document->root();
+        size_t depth = 0;
+        while (!node->is_number_array()) {
+            node = node->is_object() ? &node->as_object().at("k") : &node->as_array()[0];
+            ++depth;
+        }
+        REQUIRE(depth == 200000 - 1); // The innermost array is packed
+        REQUIRE(node->as_number_array()[0] == 1);
+    }
+}
+
+// Writes each event as a short token, to compare whole event sequences
+class EventLog : public JSONHandler {
+public:
+    std::string log;
+    std::string stop_at_key; // Stops the parse when this key arrives
+
+    bool null() override { return put("null"); }
+    bool boolean(bool b) override { return put(b ? "true" : "false"); }
+    bool integer(int64_t i) override { return put("i:" + std::to_string(i)); }
+    bool number(double d) override {
+        char digits[MAX_NUMBER_LENGTH];
+        return put("d:" + std::string(digits, format_json_number(d, digits)));
+    }
+    bool string(std::string_view s) override { return put("s:" + std::string(s)); }
+    bool start_object() override { return put("{"); }
+    bool key(std::string_view k) override {
+        put("k:" + std::string(k));
+        return k != stop_at_key;
+    }
+    bool end_object() override { return put("}"); }
+    bool start_array() override { return put("["); }
+    bool end_array() override { return put("]"); }
+
+private:
+    bool put(const std::string& token) {
+        log += (log.empty() ? "" : " ") + token;
+        return true;
+    }
+};
+
+TEST_CASE("Event Parser Reports Documents Without A Tree") {
+    EventLog events;
+    REQUIRE(JSON::parse_events(R"({"b": [1, 2.5, -0, 1e3, 9007199254740993, 18446744073709551616],
+                                   "a\u00e9": {"s": "x\"y", "e": {}, "l": []}, "z": [true, false, null]})", events));
+    REQUIRE(events.log == "{ k:b [ i:1 d:2.5 d:-0 d:1000 i:9007199254740993 d:18446744073709551616 ] "
+                          "k:a\xC3\xA9 { k:s s:x\"y k:e { } k:l [ ] } k:z [ true false null ] }");
+
+    // Scalars at the root; callbacks a handler leaves out default to going on
+    for (auto [text, log] : std::vector<std::pair<const char*, const char*>>{{"42", "i:42"}, {"\"only\"", "s:only"}, {"null", "null"}}) {
+        EventLog scalar;
+        REQUIRE(JSON::parse_events(text, scalar));
+        REQUIRE(scalar.log == log);
+    }
+    JSONHandler ignore_all;
+    REQUIRE(JSON::parse_events(R"({"a": [1, {"b": "c"}]})", ignore_all));
+
+    // A handler can stop early; nothing after that point is read, so later errors go unnoticed
+    EventLog early;
+    early.stop_at_key = "stop";
+    REQUIRE_FALSE(JSON::parse_events(R"({"a": 1, "stop": 2, "broken": [})", early));
+    REQUIRE(early.log == "{ k:a i:1 k:stop");
+
+    // Same grammar, errors and depth limit as JSON::parse
+    for (const char* text : {"[1, 2}", R"({"a" 1})", "{1: 2}", "[1, ]", "[nul]", "\"open", "[\"\\q\"]"}) {
+        std::string tree_error, event_error;
+        try {
+            JSON::parse(text);
+        } catch (const JSONError& e) {
+            tree_error = e.what();
+        }
+        try {
+            EventLog log;
+            JSON::parse_events(text, log);
+        } catch (const JSONError& e) {
+            event_error = e.what();
+        }
+        INFO(text);
+        REQUIRE_FALSE(tree_error.empty());
+        REQUIRE(event_error == tree_error);
+    }
+    EventLog deep;
+    REQUIRE_THROWS_WITH(JSON::parse_events(std::string(100, '['), deep, 10), "Maximum nesting depth exceeded");
+
+    // Pulling a few values out of many records without materializing any of them
+    class PriceSum : public JSONHandler {
+        bool in_price = false;
+    public:
+        double total = 0;
+        size_t depth = 0;
+        bool start_object() override { ++depth; return true; }
+        bool end_object() override { --depth; return true; }
+        bool key(std::string_view k) override { in_price = depth == 2 && k == "price"; return true; }
+        bool integer(int64_t i) override { return number(static_cast<double>(i)); }
+        bool number(double d) override {
+            if (in_price) total += d;
+            in_price = false;
+            return true;
+        }
+    } prices;
+    std::string records = R"({"items": [)";
+    for (int i = 0; i < 1000; ++i) records += (i ? "," : "") + std::string(R"({"id": 1, "price": )") + std::to_string(i) + R"(, "meta": {"price": 1000000}})";
+    records += "]}";
+    REQUIRE(JSON::parse_events(records, prices));
+    REQUIRE(prices.total == 999 * 1000 / 2);
+}
+
+TEST_CASE("Streams Take Values From Chunks Of Any Size") {
+    // Values of every kind, back to back or on lines of their own, with strings that hold
+    // brackets, quotes and escapes the boundary scan must not mistake for structure
+    const std::string input = "{\"a\": [1, {\"b\": \"]}\"}], \"c\": \"\\\"{\\\\\"}\n"
+                              "[1,2,3][4]  \"x\\\\\" \"[\"\t42 -1.5e3\ntrue null false{\"d\":{}}\r\n\"\\u00e9\"";
+    const std::vector<std::string> expected = {
+        R"({"a":[1,{"b":"]}"}],"c":"\"{\\"})", "[1,2,3]", "[4]", R"("x\\")", R"("[")", "42", "-1500",
+        "true", "null", "false", R"({"d":{}})", "\"\xC3\xA9\""};
+    for (size_t chunk = 1; chunk <= input.size(); ++chunk) {
+        JSONStream stream;
+        std::vector<std::string> values;
+        auto drain = [&] {
+            while (JSONDocumentPtr document = stream.next_document()) {
+                JSONWriter writer;
+                writer.write(document->root());
+                values.push_back(writer.take());
+            }
+        };
+        for (size_t i = 0; i < input.size(); i += chunk) {
+            stream.feed(std::string_view(input).substr(i, chunk));
+            drain();
+        }
+        stream.finish();
+        drain();
+        INFO(chunk);
+        REQUIRE(values == expected);
+    }
+
+    // A container or string is ready on its last byte; a root number waits for what follows
+    JSONStream stream;
+    std::string_view text;
+    stream.feed("{\"id\": 1");
+    REQUIRE_FALSE(stream.next(text));
+    stream.feed("}{");
+    REQUIRE(stream.next(text));
+    REQUIRE(text == "{\"id\": 1}");
+    REQUIRE_FALSE(stream.next(text));
+    stream.feed("}12");
+    REQUIRE(stream.next(text));
+    REQUIRE(text == "{}");
+    REQUIRE_FALSE(stream.next(text));
+    stream.feed("3");
+    REQUIRE_FALSE(stream.next(text));
+    stream.finish();
+    REQUIRE(stream.next(text));
+    REQUIRE(text == "123");
+
+    // A bad value is taken along with its error, and the stream goes on after it
+    JSONStream lines;
+    lines.feed("{\"ok\": 1}\n{\"bad\" 2}\n12ab\n[3]\n{\"open\": ");
+    REQUIRE(lines.next_document()->root().as_object().at("ok").as_number() == 1);
+    REQUIRE_THROWS_AS(lines.next_document(), JSONError);
+    REQUIRE_THROWS_AS(lines.next_document(), JSONError);
+    REQUIRE(lines.next_document()->root().as_number_array()[0] == 3);
+    REQUIRE(lines.next_document() == nullptr);
+    lines.finish();
+    REQUIRE_THROWS_AS(lines.next_document(), JSONError); // Truncated at the end of the input
+    REQUIRE(lines.next_document() == nullptr);
+
+    // Events come from the same values, and the depth limit holds while feeding
+    JSONStream events;
+    events.feed("{\"k\": [true, \"s\"]} 7 ");
+    EventLog log;
+    REQUIRE(events.next_events(log));
+    REQUIRE(events.next_events(log));
+    REQUIRE_FALSE(events.next_events(log));
+    REQUIRE(log.log == "{ k:k [ true s:s ] } i:7");
+    // A root number or literal must be the whole value, as when it is taken as a document
+    events.feed("12ab nul truex 5");
+    events.finish();
+    for (int i = 0; i < 3; ++i) {
+        EventLog bad;
+        REQUIRE_THROWS_AS(events.next_events(bad), JSONError);
+    }
+    REQUIRE(events.next_events(log));
+    REQUIRE(log.log == "{ k:k [ true s:s ] } i:7 i:5");
+    EventLog trailing;
+    REQUIRE(JSON::parse_events("[1] x", trailing)); // Lenient by default, like JSON::parse
+    REQUIRE_THROWS_WITH(JSON::parse_events("[1] x", trailing, JSON_MAX_DEPTH, true), "Unexpected content after JSON value");
+    REQUIRE(JSON::parse_events("[1] \n", trailing, JSON_MAX_DEPTH, true));
+    JSONStream deep(JSONStream::Values, JSONStream::Separate, 10);
+    deep.feed(std::string(10, '['));
+    REQUIRE_THROWS_WITH(deep.feed("["), "Maximum nesting depth exceeded");
+}
+
+TEST_CASE("NDJSON Lines Fail One At A Time") {
+    // A truncated line, a bare word, trailing content and deep nesting each fail on their
+    // own line; the lines after them parse, and line numbers count blank lines too
+    const std::string input = "{\"a\": 1}\n{\"a\":\"trunc\n{\"a\": 3}\n\nnot json\n{\"a\": 5} x\r\n"
+                              "[[[[[1]]]]]\n  \"s\\n\"  \r\n12ab\n7\n{\"a\": [\"]\", \"\\\"\"]}";
+    const std::vector<std::string> expected = {
+        "1:{\"a\":1}", "2:error", "3:{\"a\":3}", "5:error", "6:error", "7:error", "8:\"s\\n\"", "9:error", "10:7",
+        "11:{\"a\":[\"]\",\"\\\"\"]}"};
+    for (size_t chunk = 1; chunk <= input.size(); ++chunk) {
+        JSONStream stream(JSONStream::Lines, JSONStream::Separate, 4);
+        std::vector<std::string> outcomes;
+        auto drain = [&] {
+            while (true) {
+                try {
+                    JSONDocumentPtr document = stream.next_document();
+                    if (!document) return;
+                    JSONWriter writer;
+                    writer.write(document->root());
+                    outcomes.push_back(std::to_string(stream.last_line()) + ":" + writer.take());
+                } catch (const JSONError&) {
+                    outcomes.push_back(std::to_string(stream.last_line()) + ":error");
+                }
+            }
+        };
+        for (size_t i = 0; i < input.size(); i += chunk) {
+            stream.feed(std::string_view(input).substr(i, chunk));
+            drain();
+        }
+        stream.finish();
+        drain();
+        INFO(chunk);
+        REQUIRE(outcomes == expected);
+    }
+
+    // A line is ready at its newline, not at the end of its value, since more may follow
+    JSONStream stream(JSONStream::Lines);
+    std::string_view text;
+    stream.feed("{\"id\": 1}");
+    REQUIRE_FALSE(stream.next(text));
+    stream.feed(" junk\n[2]\n");
+    REQUIRE_THROWS_WITH(stream.next(text), "Unexpected content after JSON value");
+    REQUIRE(stream.last_line() == 1);
+    REQUIRE(stream.next(text));
+    REQUIRE(text == "[2]");
+    REQUIRE(stream.last_line() == 2);
+
+    // The parser's own error wins over the trailing content, for documents and events alike
+    stream.feed("nul x\ntrue\n");
+    EventLog log;
+    REQUIRE_THROWS_WITH(stream.next_events(log), "Invalid JSON null");
+    REQUIRE(stream.next_events(log));
+    REQUIRE(log.log == "true");
+    REQUIRE(stream.last_line() == 4);
+}
+
+TEST_CASE("Records Reuse One Key Table And Evaluator") {
+    std::string lines;
+    for (int i = 0; i < 50; ++i) {
+        lines += R"({"id": )" + std::to_string(i) + R"(, "http": {"status": 200, "ms": )" + std::to_string(i) + "}}\n";
+        if (i % 10 == 9) lines += R"({"other": 1, "http": {"ms": 1000}})" "\n"; // Another shape now and then
+    }
+    CompiledExpression expr = CompiledExpression::compile("http.ms * 2");
+    for (auto keys : {JSONStream::Separate, JSONStream::Shared}) {
+        JSONStream stream(JSONStream::Lines, keys);
+        stream.feed(lines);
+        Evaluator evaluator(std::make_shared<const JSONDocument>(JSONValue(nullptr)));
+        std::vector<JSONDocumentPtr> documents;
+        double total = 0;
+        while (JSONDocumentPtr document = stream.next_document(JSONDocument::Arena)) {
+            evaluator.set_document(document);
+            total += evaluator.evaluate(expr).as_number();
+            documents.push_back(document);
+        }
+        REQUIRE(documents.size() == 55);
+        REQUIRE(total == 2 * (49 * 50 / 2 + 5 * 1000));
+        // Shared: records with the same fields have the same shape, so cached slots carry over
+        bool shared = keys == JSONStream::Shared;
+        REQUIRE((&documents[0]->keys() == &documents[1]->keys()) == shared);
+        REQUIRE((&documents[0]->root().as_object().shape() == &documents[1]->root().as_object().shape()) == shared);
+        REQUIRE(&documents[0]->root().as_object().shape() != &documents[10]->root().as_object().shape());
+        // Earlier documents stay readable while later ones are parsed into the same table
+        REQUIRE(documents[3]->root().as_object().at("id").as_number() == 3);
+    }
+    REQUIRE_THROWS_AS(Evaluator(JSONValue(nullptr)).set_document(nullptr), EvalError);
+
+    // Parser scratch carried from one parse to the next starts out empty; a large document
+    // in between does not leave anything behind either
+    std::string big = "[";
+    for (int i = 0; i < 10000; ++i) big += (i ? ",{\"k\":[" : "{\"k\":[") + std::to_string(i) + ",\"s\"]}";
+    big += "]";
+    REQUIRE(JSON::parse(R"({"a": [1, "x"]})").as_object().size() == 1);
+    REQUIRE(JSON::parse(big).array_size() == 10000);
+    REQUIRE(JSON::parse(R"([{"b": 2}])").as_array()[0].as_object().at("b").as_number() == 2);
+    REQUIRE_THROWS_AS(JSON::parse(R"({"a": [1, {"b": )"), JSONError);
+    REQUIRE(JSON::parse("[[1], {}]").as_array()[0].as_number_array().size() == 1);
+}
+
+TEST_CASE("Copies And Plain Parses Leave The Shared Table Alone") {
+    KeyTable& shared = KeyTable::shared();
+    size_t keys = shared.size();
+    size_t shapes = shared.shape_count();
+
+    std::string lines;
+    for (int i = 0; i < 2000; ++i) {
+        std::string n = std::to_string(i);
+        lines += R"({"id": )" + n + R"(, "f)" + n + R"(": {"g)" + n + R"(": [1, "x"]}})" "\n";
+    }
+    JSONStream stream(JSONStream::Lines, JSONStream::Shared);
+    stream.feed(lines);
+    Evaluator evaluator(JSONValue(nullptr));
+    std::vector<JSONValue> results;
+    for (int i = 0; JSONDocumentPtr document = stream.next_document(); ++i) {
+        evaluator.set_document(document);
+        results.push_back(evaluator.evaluate("f" + std::to_string(i))); // Objects, copied out
+    }
+    std::string_view record;
+    JSONStream plain(JSONStream::Lines);
+    plain.feed(lines);
+    for (int i = 0; plain.next(record); ++i) {
+        JSONValue parsed = JSON::parse(record);
+        JSONValue structural = StructuralParser::parse(record);
+        JSONValue copy = parsed;
+        parsed = JSONValue(nullptr); // The copy keeps the keys alive
+        REQUIRE(copy.as_object().at("id").as_number() == i);
+        REQUIRE(Evaluator(std::make_shared<const JSONDocument>(structural)).evaluate("id").as_number() == i);
+    }
+    REQUIRE(results.size() == 2000);
+    REQUIRE(results[1234].as_object().at("g1234").as_array()[1].as_string() == "x");
+    REQUIRE(shared.size() == keys);
+    REQUIRE(shared.shape_count() == shapes);
+
+    // Each object grows in a table of its own, and its stale shapes are dropped as it goes
+    JSONValue parsed = JSON::parse(R"({"b": 1})");
+    JSONObject grown = parsed.as_object();
+    for (int i = 0; i < 500; ++i) grown.insert_or_assign("k" + std::to_string(i), JSONValue(i));
+    grown.insert_or_assign("b", JSONValue(2));
+    REQUIRE(grown.size() == 501);
+    REQUIRE(grown.at("k499").as_integer() == 499);
+    REQUIRE(grown.at("b").as_integer() == 2);
+    REQUIRE(grown.shape().table->shape_count() <= 8);
+    REQUIRE(parsed.as_object().size() == 1);
+    REQUIRE(Evaluator(std::make_shared<const JSONDocument>(JSONValue(grown))).evaluate("k250 + b").as_number() == 252);
+    REQUIRE(shared.size() == keys);
+    REQUIRE(shared.shape_count() == shapes);
+}
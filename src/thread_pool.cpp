@@ -0,0 +1,116 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <exception>
+
+// Identifies the pool and queue owned by the current thread, if it is a worker
+static thread_local const ThreadPool* current_pool = nullptr;
+static thread_local size_t current_queue = 0;
+
+ThreadPool::ThreadPool(size_t threads) {
+    for (size_t i = 0; i < threads; ++i) queues.push_back(std::make_unique<Queue>());
+    for (size_t i = 0; i < threads; ++i) workers.emplace_back(&ThreadPool::worker_loop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        stopping = true;
+    }
+    idle.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+void ThreadPool::push(std::function<void()> task) {
+    // Workers keep their own subtasks local; other threads spread work round-robin
+    size_t index = current_pool == this ? current_queue : next_queue++ % queues.size();
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    {
+        // Taking the lock orders this against a worker about to sleep, so the wakeup is not lost
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        queued++;
+    }
+    idle.notify_one();
+}
+
+bool ThreadPool::pop(std::function<void()>& task) {
+    size_t count = queues.size();
+    size_t own = current_pool == this ? current_queue : 0;
+
+    if (current_pool == this) {
+        Queue& queue = *queues[own];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i <= count; ++i) {
+        Queue& victim = *queues[(own + i) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(size_t index) {
+    current_pool = this;
+    current_queue = index;
+
+    while (true) {
+        std::function<void()> task;
+        if (pop(task)) {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(idle_mutex);
+        idle.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0) return;
+    }
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)>& fn) {
+    if (workers.empty() || count < 2) {
+        for (size_t i = 0; i < count; ++i) fn(i);
+        return;
+    }
+
+    std::atomic<size_t> remaining{count};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto run = [&](size_t i) {
+        try {
+            fn(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) error = std::current_exception();
+        }
+        remaining.fetch_sub(1, std::memory_order_acq_rel);
+    };
+
+    for (size_t i = 1; i < count; ++i) push([&run, i] { run(i); });
+    run(0);
+
+    // Help out instead of blocking until every index has run
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        std::function<void()> task;
+        if (pop(task)) task();
+        else std::this_thread::yield();
+    }
+    if (error) std::rethrow_exception(error);
+}
@@ -0,0 +1,52 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent work-stealing pool. Each worker owns a deque: it pops its own
+// newest task first and steals the oldest task from other workers when idle.
+// Threads that wait on a parallel_for help run queued tasks, so nested
+// parallel calls never deadlock.
+class ThreadPool {
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex idle_mutex;
+    std::condition_variable idle;
+    std::atomic<size_t> queued{0};
+    std::atomic<size_t> next_queue{0};
+    bool stopping = false;
+
+    void push(std::function<void()> task);
+    bool pop(std::function<void()>& task);
+    void worker_loop(size_t index);
+
+public:
+    // threads == 0 runs everything on the calling thread
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    // Runs fn(0) .. fn(count - 1), possibly in parallel, and returns once all
+    // have finished. The first exception thrown by fn is rethrown here.
+    void parallel_for(size_t count, const std::function<void(size_t)>& fn);
+
+    // Process-wide pool with one worker per hardware thread, created on first use
+    static ThreadPool& shared();
+};
+
+#endif
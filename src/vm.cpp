@@ -0,0 +1,113 @@
+#include "evaluator.h"
+#include <vector>
+
+// Stack slots kept on the C++ stack; deeper programs fall back to the heap
+static const size_t INLINE_STACK = 16;
+
+Operand Evaluator::execute(const Program& program) const {
+    Operand inline_stack[INLINE_STACK];
+    std::vector<Operand> heap_stack;
+    Operand* stack = inline_stack;
+    if (program.max_stack > INLINE_STACK) {
+        heap_stack.resize(program.max_stack);
+        stack = heap_stack.data();
+    }
+
+    const Instruction* code = program.code.data();
+    size_t sp = 0;
+    size_t pc = 0;
+
+    while (true) {
+        const Instruction& ins = code[pc++];
+        switch (ins.op) {
+            case OpCode::PushNumber:
+                stack[sp++] = Operand::of_number(program.constants[ins.operand]);
+                break;
+            case OpCode::PushBool:
+                stack[sp++] = Operand::of_bool(ins.operand != 0);
+                break;
+            case OpCode::PushNull:
+                stack[sp++] = Operand();
+                break;
+            case OpCode::LoadPath:
+                stack[sp++] = resolve_path(program.paths[ins.operand]);
+                break;
+            case OpCode::Neg:
+                if (stack[sp - 1].kind != Operand::Number) throw EvalError("Unary '-' requires a numeric operand");
+                stack[sp - 1] = Operand::of_number(-stack[sp - 1].number);
+                break;
+            case OpCode::Not:
+                stack[sp - 1] = Operand::of_bool(!truthy(stack[sp - 1]));
+                break;
+            case OpCode::ToBool:
+                stack[sp - 1] = Operand::of_bool(truthy(stack[sp - 1]));
+                break;
+            case OpCode::AndJump:
+                if (!truthy(stack[sp - 1])) {
+                    stack[sp - 1] = Operand::of_bool(false);
+                    pc = ins.operand;
+                } else {
+                    --sp;
+                }
+                break;
+            case OpCode::OrJump:
+                if (truthy(stack[sp - 1])) {
+                    stack[sp - 1] = Operand::of_bool(true);
+                    pc = ins.operand;
+                } else {
+                    --sp;
+                }
+                break;
+
+            // Numeric fast paths; anything else goes through the shared semantics for errors
+            case OpCode::Add:
+            case OpCode::Sub:
+            case OpCode::Mul: {
+                Operand& l = stack[sp - 2];
+                const Operand& r = stack[sp - 1];
+                --sp;
+                if (l.kind == Operand::Number && r.kind == Operand::Number) {
+                    if (ins.op == OpCode::Add) l.number += r.number;
+                    else if (ins.op == OpCode::Sub) l.number -= r.number;
+                    else l.number *= r.number;
+                    l.ref = nullptr; // No longer the document's value
+                } else {
+                    Operator op = ins.op == OpCode::Add ? Operator::Add : ins.op == OpCode::Sub ? Operator::Sub : Operator::Mul;
+                    l = apply_arithmetic(op, l, r);
+                }
+                break;
+            }
+            case OpCode::Div:
+                stack[sp - 2] = apply_arithmetic(Operator::Div, stack[sp - 2], stack[sp - 1]);
+                --sp;
+                break;
+            case OpCode::Mod:
+                stack[sp - 2] = apply_arithmetic(Operator::Mod, stack[sp - 2], stack[sp - 1]);
+                --sp;
+                break;
+            case OpCode::Pow:
+                stack[sp - 2] = apply_arithmetic(Operator::Pow, stack[sp - 2], stack[sp - 1]);
+                --sp;
+                break;
+
+            case OpCode::Call: {
+                size_t argc = ins.operand;
+                Operand* args = stack + sp - argc;
+                *args = call_function(static_cast<Function>(ins.aux), args, argc);
+                sp -= argc - 1;
+                break;
+            }
+            case OpCode::CallParallel: {
+                const std::vector<Program>& programs = program.parallel_args[ins.operand];
+                std::vector<Operand> args(programs.size());
+                std::vector<size_t> costs;
+                for (const Program& arg : programs) costs.push_back(arg.cost);
+                dispatch_arguments(costs, [&](size_t i) { args[i] = execute(programs[i]); });
+                stack[sp++] = call_function(static_cast<Function>(ins.aux), args.data(), args.size());
+                break;
+            }
+            case OpCode::Return:
+                return stack[sp - 1];
+        }
+    }
+}